@@ -0,0 +1,86 @@
+#ifndef __BENCH_HPP__
+#define __BENCH_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * A minimal benchmark harness.
+ * Every benchmark prints one JSON object per line, so the output of two
+ * builds can be compared with any JSON tool:
+ * {"name": "...", "ops": N, "ns_per_op": x, "allocs_per_op": y,
+ *  "bytes_per_op": b, "mb_per_s": z}
+ */
+
+struct BenchOptions {
+    // Only the benchmarks whose name contains the filter are run.
+    std::string filter;
+    // Multiplies the number of operations of every benchmark.
+    double scale = 1;
+};
+
+/*
+ * Get the number of allocations (operator new) made so far, by any thread.
+ */
+uint64_t allocation_count();
+
+/*
+ * Run a benchmark if selected, and print its result.
+ * @param options: The options of the run.
+ * @param name: The name of the benchmark, e.g. "parser/avx2".
+ * @param ops: The number of operations, before scaling.
+ * @param bytes_per_op: The bytes processed by an operation, 0 if meaningless.
+ * @param run: Called as run(n) to do n operations, returns false on failure.
+ */
+template <typename F>
+void run_bench(const BenchOptions &options, const std::string &name, size_t ops, size_t bytes_per_op, F &&run) {
+    if (name.find(options.filter) == std::string::npos) {
+        return;
+    }
+    ops = static_cast<size_t>(ops * options.scale);
+    if (ops == 0) {
+        ops = 1;
+    }
+
+    // Warm up the caches and the lazily allocated state.
+    if (!run(ops / 10 + 1)) {
+        fprintf(stderr, "%s: failed\n", name.c_str());
+        return;
+    }
+
+    uint64_t allocs = allocation_count();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = run(ops);
+    double ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+    allocs = allocation_count() - allocs;
+    if (!ok) {
+        fprintf(stderr, "%s: failed\n", name.c_str());
+        return;
+    }
+
+    printf(
+        "{\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, "
+        "\"bytes_per_op\": %zu, \"mb_per_s\": %.1f}\n",
+        name.c_str(),
+        ops,
+        ns / ops,
+        static_cast<double>(allocs) / ops,
+        bytes_per_op,
+        bytes_per_op * ops / ns * 1e3
+    );
+    fflush(stdout);
+}
+
+// The benchmarks of every area, one file each.
+void parser_benches(const BenchOptions &options);
+void message_benches(const BenchOptions &options);
+void container_benches(const BenchOptions &options);
+void route_benches(const BenchOptions &options);
+void io_benches(const BenchOptions &options);
+void worker_benches(const BenchOptions &options);
+
+#endif
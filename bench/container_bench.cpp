@@ -0,0 +1,62 @@
+#include "Bench.hpp"
+#include "Map.hpp"
+#include "Queue.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Map<> and Queue<> benchmarks, alone and under contention.
+ * Every thread does the operations on the shared container, an operation
+ * is one push and one pop (Queue) or one insert, find and erase (Map),
+ * counted over all the threads.
+ */
+
+// Run the operations split over the threads, and wait for them.
+template <typename F>
+static bool run_threads(size_t thread_num, size_t n, F &&work) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_num; t++) {
+        size_t begin = n * t / thread_num;
+        size_t end = n * (t + 1) / thread_num;
+        threads.emplace_back([&work, t, begin, end]() {
+            work(t, end - begin);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return true;
+}
+
+void container_benches(const BenchOptions &options) {
+    const size_t thread_nums[] = {1, 4};
+    for (size_t thread_num : thread_nums) {
+        std::string suffix = "_" + std::to_string(thread_num) + "threads";
+
+        Queue<std::string> queue;
+        const std::string message = "[INFO] GET /test.html HTTP/1.1 from 127.0.0.1:51234";
+        run_bench(options, "container/queue_push_pop" + suffix, 200000, 0, [&](size_t n) {
+            return run_threads(thread_num, n, [&](size_t, size_t count) {
+                for (size_t i = 0; i < count; i++) {
+                    queue.push(message);
+                    queue.pop();
+                }
+            });
+        });
+
+        Map<int, std::string> map;
+        run_bench(options, "container/map_insert_find_erase" + suffix, 200000, 0, [&](size_t n) {
+            return run_threads(thread_num, n, [&](size_t t, size_t count) {
+                for (size_t i = 0; i < count; i++) {
+                    int key = static_cast<int>(t << 20 | (i & 1023));
+                    std::unique_lock<std::mutex> lock(map.get_mutex());
+                    map.insert_or_assign(key, "client", lock);
+                    if (map.check_exist(key, lock)) {
+                        map.erase(key, lock);
+                    }
+                }
+            });
+        });
+    }
+}
@@ -0,0 +1,213 @@
+#include "Bench.hpp"
+#include "Epoll.hpp"
+#include "Receiver.hpp"
+#include "Sender.hpp"
+#include "Uring.hpp"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/*
+ * Event loop benchmarks over socket pairs, with epoll and with io_uring.
+ * Every round the client writes a request on every socket, the server side
+ * receives, parses and answers them like a reactor, and the client reads
+ * the responses back. An operation is one request.
+ */
+
+// The number of connections served at once.
+static const size_t SOCKET_NUM = 64;
+
+static const char REQUEST[] = "GET /test.html HTTP/1.1\r\nHost: bench\r\nConnection: keep-alive\r\n\r\n";
+
+// The user data of a recv or a send on a connection, 0 is the one of Uring.
+static inline uint64_t uring_data(size_t index, bool send) {
+    return (index + 1) << 1 | send;
+}
+
+struct Connection {
+    int client;
+    int server;
+    std::unique_ptr<Receiver> receiver;
+    std::unique_ptr<Sender> sender;
+    msghdr msg;
+    iovec iov[URING_SEND_IOV_NUM];
+};
+
+// Write a request on every connection.
+static bool write_requests(std::vector<Connection> &connections) {
+    for (Connection &connection : connections) {
+        if (write(connection.client, REQUEST, sizeof(REQUEST) - 1) != sizeof(REQUEST) - 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read a response of a known size back from every connection.
+static bool read_responses(std::vector<Connection> &connections, size_t bytes) {
+    char buffer[4096];
+    for (Connection &connection : connections) {
+        size_t received = 0;
+        while (received < bytes) {
+            ssize_t ret = read(connection.client, buffer, sizeof(buffer));
+            if (ret <= 0) {
+                return false;
+            }
+            received += ret;
+        }
+    }
+    return true;
+}
+
+// Queue a response for every request received on a connection.
+static size_t answer(Connection &connection, const Response &response) {
+    size_t num = 0;
+    Request request;
+    while (connection.receiver->get_request(request)) {
+        connection.sender->queue_response(Response(response));
+        num++;
+    }
+    connection.receiver->release_buffer();
+    return num;
+}
+
+void io_benches(const BenchOptions &options) {
+    BufferPool pool(BUFFER_SIZE, BUFFER_BLOCK_SIZE, false);
+    std::vector<Connection> connections(SOCKET_NUM);
+    for (Connection &connection : connections) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+            fprintf(stderr, "io: socketpair failed, errno: %d\n", errno);
+            return;
+        }
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        connection.client = fds[0];
+        connection.server = fds[1];
+        connection.receiver.reset(new Receiver(connection.server, pool));
+        connection.sender.reset(new Sender(connection.server));
+    }
+
+    std::string body(325, 'x');
+    Headers headers = {
+        {"Content-Type", "text/html"},
+        {"Content-Length", std::to_string(body.size())},
+        {"Connection", "keep-alive"}
+    };
+    Response response(StatusCodes::OK, "HTTP/1.1", headers, "");
+    response.set_shared_body({nullptr, body.data(), body.size()});
+    size_t bytes = response.to_string().size();
+
+    {
+        Epoll epoll;
+        for (size_t i = 0; i < SOCKET_NUM; i++) {
+            epoll.add(connections[i].server, EPOLLIN, i);
+        }
+        std::vector<epoll_event> events(MAX_EPOLL_EVENTS);
+        run_bench(options, "io/epoll_requests", 200000, bytes, [&](size_t n) {
+            for (size_t round = 0; round < (n + SOCKET_NUM - 1) / SOCKET_NUM; round++) {
+                if (!write_requests(connections)) {
+                    return false;
+                }
+                size_t answered = 0;
+                while (answered < SOCKET_NUM) {
+                    int count = epoll.wait(events, -1);
+                    if (count == -1) {
+                        return false;
+                    }
+                    for (int i = 0; i < count; i++) {
+                        Connection &connection = connections[events[i].data.u64];
+                        if (connection.receiver->receive() == ReceiveStatus::ERROR) {
+                            return false;
+                        }
+                        answered += answer(connection, response);
+                        if (connection.sender->flush() != SendStatus::DONE) {
+                            return false;
+                        }
+                    }
+                }
+                if (!read_responses(connections, bytes)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    if (!Uring::supported()) {
+        fprintf(stderr, "io/uring_requests: skipped, io_uring is not supported\n");
+    } else {
+        Uring uring(URING_ENTRIES, URING_BUFFER_NUM, URING_BUFFER_SIZE);
+        for (size_t i = 0; i < SOCKET_NUM; i++) {
+            uring.prepare_recv(connections[i].server, uring_data(i, false));
+        }
+        std::vector<io_uring_cqe> cqes(MAX_URING_EVENTS);
+        run_bench(options, "io/uring_requests", 200000, bytes, [&](size_t n) {
+            for (size_t round = 0; round < (n + SOCKET_NUM - 1) / SOCKET_NUM; round++) {
+                if (!write_requests(connections)) {
+                    return false;
+                }
+                size_t sent = 0;
+                while (sent < SOCKET_NUM) {
+                    int count = uring.wait(cqes, -1);
+                    if (count == -1) {
+                        return false;
+                    }
+                    for (int i = 0; i < count; i++) {
+                        const io_uring_cqe &cqe = cqes[i];
+                        if (cqe.user_data == Uring::INTERNAL_DATA) {
+                            continue;
+                        }
+                        size_t index = (cqe.user_data >> 1) - 1;
+                        Connection &connection = connections[index];
+                        if (cqe.user_data & 1) {
+                            if (cqe.res < 0) {
+                                return false;
+                            }
+                            connection.sender->complete(cqe.res);
+                            sent++;
+                            continue;
+                        }
+                        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                            uring.prepare_recv(connection.server, uring_data(index, false));
+                        }
+                        if (cqe.res == -ENOBUFS) {
+                            continue;
+                        }
+                        if (cqe.res <= 0) {
+                            return false;
+                        }
+                        uint16_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                        size_t used;
+                        connection.receiver->receive(uring.buffer(id), cqe.res, used);
+                        uring.recycle(id);
+                        if (answer(connection, response) > 0) {
+                            bool more;
+                            memset(&connection.msg, 0, sizeof(connection.msg));
+                            connection.msg.msg_iov = connection.iov;
+                            connection.msg.msg_iovlen = connection.sender->gather(
+                                connection.iov, URING_SEND_IOV_NUM, more
+                            );
+                            uring.prepare_sendmsg(
+                                connection.server, &connection.msg, MSG_NOSIGNAL | MSG_WAITALL, false,
+                                uring_data(index, true)
+                            );
+                        }
+                    }
+                }
+                if (!read_responses(connections, bytes)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    for (Connection &connection : connections) {
+        close(connection.client);
+        close(connection.server);
+    }
+}
@@ -0,0 +1,59 @@
+#include "Bench.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Count every allocation of the process.
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+uint64_t allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+int main(int argc, char *argv[]) {
+    // in order: <filter> <scale>
+    BenchOptions options;
+    if (argc > 1) {
+        options.filter = argv[1];
+    }
+    if (argc > 2) {
+        options.scale = atof(argv[2]);
+    }
+
+    parser_benches(options);
+    message_benches(options);
+    container_benches(options);
+    route_benches(options);
+    io_benches(options);
+    worker_benches(options);
+    return 0;
+}
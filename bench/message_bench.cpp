@@ -0,0 +1,132 @@
+#include "Bench.hpp"
+#include "Message.hpp"
+#include <vector>
+
+/*
+ * Response serialization benchmarks.
+ * An operation is one response: a typical 200 with a cached body, and an
+ * error page answered by a CannedResponse, or one hand-over of a request
+ * and a response, or one lookup of a known and of another header.
+ */
+
+// The size of a typical cached page.
+static const size_t BODY_SIZE = 4096;
+
+void message_benches(const BenchOptions &options) {
+    std::string body(BODY_SIZE, 'x');
+    Headers headers = {
+        {"Content-Type", "text/html"},
+        {"Content-Length", std::to_string(body.size())},
+        {"Connection", "keep-alive"}
+    };
+    Response response(StatusCodes::OK, "HTTP/1.1", headers, "");
+    response.set_shared_body({nullptr, body.data(), body.size()});
+    size_t bytes = response.to_string().size();
+
+    std::vector<iovec> iov;
+    size_t total = 0;
+    run_bench(options, "message/serialize", 1000000, bytes, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            iov.clear();
+            if (response.serialize(iov) != bytes) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    run_bench(options, "message/to_string", 200000, bytes, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (response.to_string().size() != bytes) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    run_bench(options, "message/build_response", 200000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            Response built(StatusCodes::OK, "HTTP/1.1", headers, "");
+            built.set_shared_body({nullptr, body.data(), body.size()});
+            iov.clear();
+            if (built.serialize(iov) != bytes) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // A request and its response are handed over by moves from the receiver
+    // to the sender, no string, header or body may be copied on the way.
+    Request request(MethodTypes::POST, "/dopost?from=message_bench", "HTTP/1.1", body, headers);
+    Response moved(StatusCodes::OK, "HTTP/1.1", headers, body);
+    run_bench(options, "message/move_request_response", 1000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            Request taken = std::move(request);
+            request = std::move(taken);
+            Response sent = std::move(moved);
+            moved = std::move(sent);
+        }
+        return request.get_body().size() == BODY_SIZE && moved.get_body().size() == BODY_SIZE;
+    });
+
+    // The headers of a typical browser request, looked up by the server.
+    Headers browser = {
+        {"Host", "localhost:2024"},
+        {"User-Agent", "Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0"},
+        {"Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8"},
+        {"Accept-Language", "en-US,en;q=0.5"},
+        {"Accept-Encoding", "gzip, deflate, br"},
+        {"Connection", "keep-alive"},
+        {"Upgrade-Insecure-Requests", "1"},
+        {"Sec-Fetch-Dest", "document"},
+        {"If-None-Match", "\"5f3a-1c2b\""},
+        {"Cache-Control", "max-age=0"}
+    };
+    run_bench(options, "message/header_lookup", 5000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            total += browser.get(HeaderNames::IF_NONE_MATCH)->size();
+            total += browser.get("sec-fetch-dest")->size();
+        }
+        return total > 0;
+    });
+
+    CannedResponse canned(
+        StatusCodes::NOT_FOUND,
+        {{"Content-Type", "text/html"}},
+        "<html><body><h1>404 Not Found</h1></body></html>"
+    );
+    const std::string version = "HTTP/1.1";
+    size_t canned_bytes = canned.respond(version, true).to_string().size();
+    run_bench(options, "message/canned_respond", 1000000, canned_bytes, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            Response error = canned.respond(version, true);
+            iov.clear();
+            if (error.serialize(iov) != canned_bytes) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    const StatusCodes codes[] = {
+        StatusCodes::OK,
+        StatusCodes::BAD_REQUEST,
+        StatusCodes::FORBIDDEN,
+        StatusCodes::NOT_FOUND,
+        StatusCodes::INTERNAL_SERVER_ERROR
+    };
+    run_bench(options, "message/status_code_to_string", 10000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            total += status_code_to_string(codes[i % 5]).size();
+        }
+        return total > 0;
+    });
+
+    run_bench(options, "message/date_header", 10000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            total += date_header()->size();
+        }
+        return total > 0;
+    });
+}
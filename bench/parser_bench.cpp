@@ -0,0 +1,264 @@
+#include "Bench.hpp"
+#include "Message.hpp"
+#include "Parser.hpp"
+#include "Receiver.hpp"
+#include "Scan.hpp"
+#include "Form.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Request parsing benchmarks.
+ * Compares the string-based get_request logic the Receiver used before the
+ * in-place parser with RequestParser on every scan implementation the cpu
+ * supports, and runs the Receiver over a socketpair, with headers captured
+ * from common browsers. An operation is one request.
+ * The form benchmarks compare the login parsing of the server before the
+ * handlers with Form, an operation is one form and a lookup of two fields.
+ */
+
+static const std::vector<std::string> REQUESTS = {
+    // Chrome
+    "GET /html/test.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:2024\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "\r\n",
+    // Firefox
+    "GET /img/logo.jpg HTTP/1.1\r\n"
+    "Host: 127.0.0.1:2024\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: image/avif,image/webp,*/*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://127.0.0.1:2024/html/test.html\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n",
+    // Safari, form post
+    "POST /dopost HTTP/1.1\r\n"
+    "Host: 127.0.0.1:2024\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Origin: http://127.0.0.1:2024\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.4.1 Safari/605.1.15\r\n"
+    "Referer: http://127.0.0.1:2024/html/test.html\r\n"
+    "Content-Length: 32\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "\r\n"
+    "login=username&pass=password.com"
+};
+
+/*
+ * The get_request logic of the Receiver before the in-place parser.
+ */
+static bool legacy_get_request(std::string &remaining_, Request &request) {
+    size_t pos = remaining_.find("\r\n\r\n");
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    MethodTypes method_type = MethodTypes::UNKNOWN;
+    std::string method, url, version, body;
+    std::unordered_map<std::string, std::string> headers;
+    size_t content_length = 0;
+    std::istringstream iss(remaining_.substr(0, pos));
+    iss >> method >> url >> version >> std::ws;
+    std::string line;
+    while (std::getline(iss, line)) {
+        if (line == "") {
+            break;
+        }
+        std::istringstream iss2(line);
+        std::string key, value;
+        iss2 >> key >> value;
+        headers.insert(std::make_pair(key.substr(0, key.size() - 1), value));
+    }
+    if (method == "GET") {
+        method_type = MethodTypes::GET;
+    } else if (method == "POST") {
+        method_type = MethodTypes::POST;
+        if (headers.find("Content-Length") != headers.end()) {
+            content_length = std::stoul(headers["Content-Length"]);
+        }
+    }
+
+    if (remaining_.size() - (pos + 4) < content_length) {
+        return false;
+    }
+    body = remaining_.substr(pos + 4, content_length);
+    remaining_.erase(0, pos + 4 + content_length);
+
+    // The request now holds Headers instead of the map.
+    Headers request_headers;
+    for (auto &header : headers) {
+        request_headers.add(header.first, header.second);
+    }
+    request = Request(method_type, url, version, body, std::move(request_headers));
+    return true;
+}
+
+static size_t average_size() {
+    size_t bytes = 0;
+    for (const std::string &request : REQUESTS) {
+        bytes += request.size();
+    }
+    return bytes / REQUESTS.size();
+}
+
+// The number of pipelined requests written to the socketpair at once.
+static const size_t PIPELINE_DEPTH = 16;
+
+// A login form with the fields a real one carries, two of them encoded.
+static const std::string FORM =
+    "login=username&pass=password&remember=on&redirect=%2Fhtml%2Ftest.html"
+    "&lang=en&theme=dark&tz=UTC%2B8&csrf=6f1c0e2a9b7d4c38";
+
+/*
+ * The login parsing of the server before the handlers: the body is copied
+ * and cut with erase, and every field goes into a map.
+ */
+static bool legacy_login_form(const std::string &body, std::string &login, std::string &pass) {
+    std::string req_body = body;
+    std::unordered_map<std::string, std::string> body_map;
+    size_t pos = 0;
+    while ((pos = req_body.find('&')) != std::string::npos) {
+        std::string pair = req_body.substr(0, pos);
+        size_t pos2 = pair.find('=');
+        body_map.insert_or_assign(pair.substr(0, pos2), pair.substr(pos2 + 1));
+        req_body.erase(0, pos + 1);
+    }
+    size_t pos2 = req_body.find('=');
+    size_t pos3 = req_body.find('.');
+    body_map.insert_or_assign(req_body.substr(0, pos2), req_body.substr(pos2 + 1, pos3 - pos2 - 1));
+    if (body_map.find("login") == body_map.end() || body_map.find("pass") == body_map.end()) {
+        return false;
+    }
+    login = body_map["login"];
+    pass = body_map["pass"];
+    return true;
+}
+
+void parser_benches(const BenchOptions &options) {
+    size_t bytes = average_size();
+
+    // The legacy logic, the request is appended as recv did.
+    std::string remaining;
+    Request request;
+    run_bench(options, "parser/legacy_get_request", 20000, bytes, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            remaining.append(REQUESTS[i % REQUESTS.size()]);
+            if (!legacy_get_request(remaining, request)) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // The in-place parser on every scan implementation supported.
+    const ScanIsa isas[] = {ScanIsa::SCALAR, ScanIsa::SSE2, ScanIsa::AVX2};
+    RequestParser parser;
+    for (ScanIsa isa : isas) {
+        if (!scan_use(isa)) {
+            continue;
+        }
+        run_bench(options, std::string("parser/request_parser_") + scan_isa_name(), 200000, bytes, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                const std::string &data = REQUESTS[i % REQUESTS.size()];
+                parser.reset();
+                if (
+                    parser.parse(data.data(), data.size()) != ParseStatus::COMPLETE ||
+                    parser.head_length() + parser.content_length() != data.size()
+                ) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+    scan_use(scan_default_isa());
+
+    // The Receiver, fed with pipelined requests through a socketpair,
+    // including the recv, the construction of the Request, and borrowing
+    // the buffer from the pool and giving it back as the reactor does.
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0) {
+        return;
+    }
+    std::string batch;
+    for (size_t i = 0; i < PIPELINE_DEPTH; i++) {
+        batch += REQUESTS[i % REQUESTS.size()];
+    }
+    BufferPool pool(BUFFER_SIZE, BUFFER_BLOCK_SIZE, false);
+    Receiver receiver(fds[1], pool);
+    run_bench(options, "parser/receiver_get_request", 100000, batch.size() / PIPELINE_DEPTH, [&](size_t n) {
+        for (size_t done = 0; done < n; done += PIPELINE_DEPTH) {
+            if (write(fds[0], batch.data(), batch.size()) != static_cast<ssize_t>(batch.size())) {
+                return false;
+            }
+            if (receiver.receive() != ReceiveStatus::RECEIVED) {
+                return false;
+            }
+            for (size_t i = 0; i < PIPELINE_DEPTH; i++) {
+                if (!receiver.get_request(request) || request.get_method_type() == MethodTypes::UNKNOWN) {
+                    return false;
+                }
+                std::string_view chunk;
+                BodyStatus status;
+                while ((status = receiver.get_body(chunk)) == BodyStatus::DATA) {
+                    request.append_body(chunk);
+                }
+                if (status != BodyStatus::COMPLETE) {
+                    return false;
+                }
+            }
+            receiver.release_buffer();
+        }
+        return true;
+    });
+    close(fds[0]);
+    close(fds[1]);
+
+    std::string login;
+    std::string pass;
+    run_bench(options, "parser/legacy_login_form", 200000, FORM.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (!legacy_login_form(FORM, login, pass) || login != "username") {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    run_bench(options, "parser/form_fields", 1000000, FORM.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            Form form(FORM);
+            std::optional<std::string_view> login = form.get("login");
+            std::optional<std::string_view> pass = form.get("pass");
+            if (!login || !pass || *login != "username") {
+                return false;
+            }
+        }
+        return true;
+    });
+}
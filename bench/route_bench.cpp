@@ -0,0 +1,69 @@
+#include "Bench.hpp"
+#include "Router.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * Route lookup benchmarks over the routes of main.
+ * An operation is one lookup of a url.
+ */
+void route_benches(const BenchOptions &options) {
+    Router router;
+    uint16_t id = 1;
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/", id++);
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/test.html", id++);
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/noimg.html", id++);
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/txt/test.txt", id++);
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/img/logo.jpg", id++);
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/favicon.ico", id++);
+    router.add(MethodTypes::GET, MountTypes::PREFIX, "/static/", id++);
+    router.add(MethodTypes::POST, MountTypes::EXACT, "/dopost", id++);
+    router.add(MethodTypes::GET, MountTypes::EXACT, "/__stats", id++);
+    router.build();
+
+    const std::vector<std::string> hits = {"/", "/test.html", "/img/logo.jpg", "/favicon.ico"};
+    const std::vector<std::string> misses = {"/wp-login.php", "/.env", "/admin/config.php", "/robots.txt"};
+    const std::vector<std::string> prefixes = {
+        "/static/html/test.html", "/static/img/logo.jpg", "/static/txt/test.txt", "/static/img/favicon.ico"
+    };
+    size_t found = 0;
+    RouteMatch match;
+
+    run_bench(options, "route/lookup_hit", 5000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            found += router.match(MethodTypes::GET, hits[i % hits.size()], match) == RouteStatus::FOUND;
+        }
+        return found > 0;
+    });
+
+    run_bench(options, "route/lookup_miss", 5000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            found += router.match(MethodTypes::GET, misses[i % misses.size()], match) == RouteStatus::NOT_FOUND;
+        }
+        return found > 0;
+    });
+
+    run_bench(options, "route/lookup_prefix", 5000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            found += router.match(MethodTypes::GET, prefixes[i % prefixes.size()], match) == RouteStatus::FOUND;
+        }
+        return found > 0;
+    });
+
+    run_bench(options, "route/lookup_query", 5000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            found += router.match(MethodTypes::GET, "/test.html?utm_source=bench", match) == RouteStatus::FOUND;
+        }
+        return found > 0;
+    });
+
+    // The url is read from the Request by reference, as the server does.
+    Request request(MethodTypes::GET, "/img/logo.jpg", "HTTP/1.1", "", {});
+    run_bench(options, "route/lookup_from_request", 2000000, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            const std::string &url = request.get_url();
+            found += router.match(request.get_method_type(), url, match) == RouteStatus::FOUND;
+        }
+        return found > 0;
+    });
+}
@@ -0,0 +1,101 @@
+#include "Bench.hpp"
+#include "WorkerPool.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+
+/*
+ * WorkerPool benchmarks, with 1 and 4 workers.
+ * An operation is one task: submitted by this thread through the injection
+ * queue and completed back through an eventfd, as a reactor does, or
+ * submitted by a task to the deque of its worker and stolen by the others.
+ */
+
+// The state shared by the tasks of a run, the last task writes the eventfd.
+struct Batch {
+    std::atomic<size_t> left;
+    int eventfd;
+};
+
+// A task as small as possible, so that the pool itself is measured.
+class CountTask : public Task {
+private:
+    Batch &batch_;
+
+public:
+    explicit CountTask(Batch &batch) : batch_(batch) {}
+
+    void run() override {
+        if (batch_.left.fetch_sub(1) == 1) {
+            uint64_t value = 1;
+            if (write(batch_.eventfd, &value, sizeof(value)) < 0) {
+                return;
+            }
+        }
+        delete this;
+    }
+};
+
+// A task submitting the others from a worker.
+class FanOutTask : public Task {
+private:
+    WorkerPool &pool_;
+    Batch &batch_;
+    size_t num_;
+
+public:
+    FanOutTask(WorkerPool &pool, Batch &batch, size_t num) : pool_(pool), batch_(batch), num_(num) {}
+
+    void run() override {
+        for (size_t i = 0; i < num_; i++) {
+            pool_.submit(new CountTask(batch_));
+        }
+        delete this;
+    }
+};
+
+// Wait for the last task of a batch.
+static bool wait_batch(Batch &batch) {
+    uint64_t value;
+    return read(batch.eventfd, &value, sizeof(value)) == sizeof(value);
+}
+
+void worker_benches(const BenchOptions &options) {
+    Batch batch;
+    batch.eventfd = eventfd(0, EFD_CLOEXEC);
+    if (batch.eventfd < 0) {
+        fprintf(stderr, "worker: eventfd failed\n");
+        return;
+    }
+
+    const size_t worker_nums[] = {1, 4};
+    for (size_t worker_num : worker_nums) {
+        std::string suffix = "_" + std::to_string(worker_num) + "workers";
+        WorkerPool pool(worker_num, WORKER_QUEUE_SIZE);
+
+        run_bench(options, "worker/inject_complete" + suffix, 500000, 0, [&](size_t n) {
+            batch.left = n;
+            for (size_t i = 0; i < n; i++) {
+                // A full queue is handled inline, as the reactors do.
+                CountTask *task = new CountTask(batch);
+                if (!pool.submit(task)) {
+                    task->run();
+                }
+            }
+            return wait_batch(batch);
+        });
+
+        run_bench(options, "worker/fan_out_steal" + suffix, 500000, 0, [&](size_t n) {
+            batch.left = n;
+            for (size_t i = 0; i < n; i += WORKER_DEQUE_SIZE) {
+                FanOutTask *task = new FanOutTask(pool, batch, std::min<size_t>(n - i, WORKER_DEQUE_SIZE));
+                if (!pool.submit(task)) {
+                    task->run();
+                }
+            }
+            return wait_batch(batch);
+        });
+    }
+    close(batch.eventfd);
+}
@@ -0,0 +1,110 @@
+#ifndef __ACCESS_LOG_HPP__
+#define __ACCESS_LOG_HPP__
+
+#include "def.hpp"
+#include "Message.hpp"
+#include "Ring.hpp"
+#include <netinet/in.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed-size binary record of a served request.
+ * It is filled on the request path and only formatted by the writer.
+ */
+struct AccessRecord {
+    int64_t timestamp;      // ns since the epoch
+    uint64_t bytes;         // bytes of the response sent, headers and body
+    in_addr_t addr;         // network byte order
+    in_port_t port;         // network byte order
+    uint16_t route;         // index of the route name given to the log
+    int16_t status;         // HTTP status code, -1 if unknown
+    int8_t method;          // MethodTypes
+};
+
+/*
+ * An asynchronous access log.
+ * Every producer (e.g. a reactor thread) owns a lock-free ring of records,
+ * pushing a record only copies it. A single background thread drains the
+ * rings, formats the records in batches and writes them with buffered
+ * writes. A record is dropped, and counted, if its ring is full, so the
+ * producers never block on the output.
+ */
+class AccessLog {
+private:
+    int fd_;
+    bool close_fd_;
+    std::vector<std::string> route_names_;
+    std::vector<std::unique_ptr<Ring<AccessRecord> > > rings_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic_bool running_;
+    std::thread writer_;
+
+    /*
+     * Drain the rings and write the formatted records until stopped.
+     */
+    void write_loop();
+
+    /*
+     * Format and write every record in the rings.
+     * @param buffer: The output buffer, reused between calls.
+     * @return The number of records written.
+     */
+    size_t drain(std::string &buffer);
+
+    /*
+     * Write the buffer to the output and clear it.
+     * @param buffer: The bytes to write.
+     */
+    void write_out(std::string &buffer);
+
+public:
+    /*
+     * Constructor.
+     * Open the output and start the writer thread.
+     * Throws std::runtime_error if the output cannot be opened.
+     * @param path: The file to append to, "-" for stdout.
+     * @param route_names: The route names, indexed by AccessRecord::route.
+     * @param producer_num: The number of producers.
+     * @param capacity: The number of records buffered per producer.
+     */
+    AccessLog(
+        const std::string &path,
+        const std::vector<std::string> &route_names,
+        size_t producer_num,
+        size_t capacity = ACCESS_LOG_RING_SIZE
+    );
+
+    /*
+     * Destructor.
+     * Write the remaining records and stop the writer thread.
+     */
+    ~AccessLog();
+
+    AccessLog(const AccessLog &) = delete;
+    AccessLog &operator=(const AccessLog &) = delete;
+
+    /*
+     * Log a request, called by the given producer only.
+     * @param producer: The index of the producer.
+     * @param record: The record to log, the timestamp is filled here.
+     * @return false if the record is dropped, true otherwise.
+     */
+    bool log(size_t producer, AccessRecord &record);
+
+    /*
+     * Get the number of records dropped because a ring was full.
+     */
+    uint64_t dropped() const;
+
+    /*
+     * Get the number of records waiting for the writer.
+     */
+    size_t depth() const;
+};
+
+#endif
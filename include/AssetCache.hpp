@@ -0,0 +1,237 @@
+#ifndef __ASSET_CACHE_HPP__
+#define __ASSET_CACHE_HPP__
+
+#include "def.hpp"
+#include "Message.hpp"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Asset {
+private:
+    // Either the bytes are held in memory, or the fd is kept open for sendfile.
+    const char *data_;
+    int fd_;
+    size_t size_;
+    std::string content_type_;
+    std::string content_length_;
+    // The validators of the conditional requests.
+    std::string etag_;
+    std::string last_modified_;
+    time_t mtime_;
+    // The bytes held in memory, copied from the file or compressed on
+    // load, data_ points to them.
+    std::string bytes_;
+    // The encoded variants, indexed by Encodings, identity is this asset.
+    std::unique_ptr<const Asset> encoded_[ENCODING_NUM];
+
+    /*
+     * Hold the bytes of a variant compressed in memory.
+     * @param compressed: The compressed bytes.
+     * @param identity: The asset compressed, its validators are reused.
+     * @param encoding: The content coding, to tell the ETag apart.
+     */
+    Asset(std::string &&compressed, const Asset &identity, Encodings encoding);
+
+    /*
+     * Load the ".br" and ".gz" sidecars of the file, and compress a
+     * compressible file held in memory with gzip if there is no ".gz" sidecar.
+     * @param path: The path of the file.
+     * @param max_memory_size: The size above which a sidecar is streamed.
+     */
+    void load_encodings(const std::string &path, size_t max_memory_size);
+
+public:
+    /*
+     * Copy the exact bytes of a file into memory, or keep the file open
+     * if it is larger than max_memory_size so it is streamed with sendfile.
+     * The bytes are copied rather than mapped: a mapping would change under
+     * the responses if the file were edited in place, and fault if it were
+     * truncated. A file changing while it is copied is copied again.
+     * @param path: The path of the file.
+     * @param content_type: The value of the Content-Type header.
+     * @param max_memory_size: The size above which the file is streamed.
+     * @param encode: Whether to prepare the encoded variants.
+     * Throws std::runtime_error if the file cannot be opened or read.
+     */
+    Asset(
+        const std::string &path,
+        const std::string &content_type,
+        size_t max_memory_size,
+        bool encode = true
+    );
+    ~Asset();
+
+    Asset(const Asset &) = delete;
+    Asset &operator=(const Asset &) = delete;
+
+    bool in_memory() const;
+    const char *data() const;
+    int fd() const;
+    size_t size() const;
+    size_t cost() const;
+    const std::string &get_content_type() const;
+    const std::string &get_content_length() const;
+
+    /*
+     * Get the strong entity tag, made of the inode, size and modification
+     * time of the file, so it changes whenever the file is replaced.
+     * @return The quoted ETag, e.g. "\"1a2b-145-17c2e9d1a3b4c5d6\"".
+     */
+    const std::string &get_etag() const;
+    const std::string &get_last_modified() const;
+    time_t get_mtime() const;
+
+    /*
+     * Get an encoded variant of the asset.
+     * @param encoding: The content coding.
+     * @return The variant, this asset for identity, nullptr if there is none.
+     */
+    const Asset *encoded(Encodings encoding) const;
+
+    /*
+     * Check whether the asset has an encoded variant, so the responses
+     * depend on Accept-Encoding.
+     */
+    bool has_encodings() const;
+};
+
+/*
+ * Check whether a media type is worth compressing, the images other than
+ * SVG, the archives and the fonts are compressed already.
+ * @param content_type: The value of the Content-Type header.
+ */
+bool is_compressible(const std::string &content_type);
+
+/*
+ * The cache of the routed files, shared by all the reactors.
+ * The files are keyed by their canonical path (realpath), so the spellings
+ * of a file share one asset; the spellings seen are kept as aliases so
+ * that a hit does not resolve the path again.
+ * A cached file is never checked on a hit. An inotify watcher thread
+ * watches the directories of the cached files instead and drops a file
+ * as soon as it (or a sidecar of it) is written, replaced or removed.
+ */
+class AssetCache {
+private:
+    struct Entry {
+        std::shared_ptr<const Asset> asset;
+        std::list<std::string>::iterator clock_it;
+        // Set on every hit, cleared by the clock hand when looking for a victim.
+        std::atomic<bool> referenced;
+        // The watch of the directory, and the spellings resolved to the path.
+        int wd;
+        std::vector<std::string> aliases;
+    };
+
+    // Hits only take the shared lock, the LRU order is approximated by the
+    // CLOCK algorithm so a hit does not need to modify the structure.
+    std::shared_mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    // The spellings of the cached paths, to their canonical path.
+    std::unordered_map<std::string, std::string> aliases_;
+    std::list<std::string> clock_;
+    std::list<std::string>::iterator hand_;
+    size_t budget_;
+    size_t max_memory_size_;
+    size_t used_;
+
+    // The cached paths by the watch descriptor of their directory, guarded
+    // by mutex_. Several directory paths may share a watch, e.g. through a
+    // bind mount, so the paths are kept whole.
+    std::unordered_map<int, std::unordered_set<std::string> > watches_;
+    // Bumped by every change, a file loaded across a change is not kept.
+    std::atomic<uint64_t> generation_;
+    int inotify_fd_;
+    int eventfd_;
+    std::thread watcher_;
+
+    /*
+     * Evict assets until there is room for the given size.
+     * The unique lock must be held.
+     * @param size: The size to make room for.
+     */
+    void make_room(size_t size);
+
+    /*
+     * Find a cached asset by any spelling of its path.
+     * The shared lock must be held.
+     * @param path: The path of the file.
+     * @return The entry, or entries_.end() if the spelling is not known.
+     */
+    std::unordered_map<std::string, Entry>::iterator find(const std::string &path);
+
+    /*
+     * Remember a spelling of a cached path. The unique lock must be held.
+     * @param path: The spelling.
+     * @param it: The entry of the canonical path.
+     */
+    void add_alias(const std::string &path, std::unordered_map<std::string, Entry>::iterator it);
+
+    /*
+     * Remove an asset, its aliases and its key of the watch.
+     * The unique lock must be held.
+     * @param it: The entry.
+     */
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+
+    /*
+     * Remove an asset. The unique lock must be held.
+     * @param path: The canonical path of the file.
+     */
+    void remove(const std::string &path);
+
+    /*
+     * Remove every asset, e.g. when inotify events are lost.
+     * The unique lock must be held.
+     */
+    void clear();
+
+    /*
+     * Read the inotify events and drop the changed files until stopped.
+     */
+    void watch();
+
+public:
+    /*
+     * Constructor.
+     * Throws std::runtime_error if the watcher cannot be started.
+     * @param budget: The maximum number of bytes held by the cache.
+     * @param max_memory_size: The size above which files are streamed instead of held in memory.
+     */
+    AssetCache(size_t budget, size_t max_memory_size);
+    ~AssetCache();
+
+    AssetCache(const AssetCache &) = delete;
+    AssetCache &operator=(const AssetCache &) = delete;
+
+    /*
+     * Get an asset, load it on a miss.
+     * An asset costing more than the budget is loaded but not kept.
+     * Its encoded variants are loaded or compressed with it.
+     * @param path: The path of the file, resolved to the key of the asset.
+     * @param content_type: The value of the Content-Type header.
+     * @return The asset, or nullptr if the file cannot be loaded.
+     */
+    std::shared_ptr<const Asset> get(const std::string &path, const std::string &content_type);
+
+    /*
+     * Check whether an asset is cached, so that getting it does not block.
+     * A spelling of the path not seen yet is reported as not cached.
+     * @param path: The path of the file.
+     */
+    bool contains(const std::string &path);
+
+    /*
+     * Get the number of bytes held by the cache.
+     */
+    size_t used();
+};
+
+#endif
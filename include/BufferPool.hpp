@@ -0,0 +1,88 @@
+#ifndef __BUFFER_POOL_HPP__
+#define __BUFFER_POOL_HPP__
+
+#include "Metrics.hpp"
+#include <cstddef>
+#include <vector>
+
+/*
+ * A pool of fixed-size buffers, borrowed by the connections only while they
+ * have bytes in flight, so an idle connection holds no buffer.
+ * The buffers are carved out of blocks mapped with mmap, and the blocks are
+ * kept until the pool is destroyed: a returned buffer goes back to a free
+ * list, so borrowing and returning are O(1) and never call the allocator.
+ * The blocks may be backed by huge pages, reserved ones (MAP_HUGETLB) if
+ * any are left, or else transparent ones, to save TLB misses.
+ * Not thread-safe, every reactor owns its own pool. The counters follow the
+ * rules of Counter, so the pool may be watched by any thread.
+ */
+class BufferPool {
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+
+    size_t buffer_size_;
+    size_t block_size_;
+    bool huge_pages_;
+    std::vector<Block> blocks_;
+    // The buffers not borrowed, the last returned is borrowed first
+    // since its pages are likely to be cached.
+    std::vector<char *> free_;
+    Counter borrowed_;
+    Counter mapped_;
+    Counter huge_mapped_;
+    Counter large_;
+
+    /*
+     * Map a new block and put its buffers on the free list.
+     * @return false if the block cannot be mapped.
+     */
+    bool grow();
+
+public:
+    /*
+     * Constructor, no memory is mapped until the first buffer is borrowed.
+     * @param buffer_size: The size of a buffer.
+     * @param block_size: The size of a block, a multiple of the huge page size.
+     * @param huge_pages: Whether to back the blocks with huge pages.
+     */
+    BufferPool(size_t buffer_size, size_t block_size, bool huge_pages);
+    ~BufferPool();
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    /*
+     * Borrow a buffer of buffer_size bytes.
+     * @return The buffer, or nullptr if no memory is left.
+     */
+    char *acquire();
+
+    /*
+     * Give a borrowed buffer back.
+     * @param buffer: The buffer, from acquire.
+     */
+    void release(char *buffer);
+
+    /*
+     * Account for a buffer of a connection grown out of the pool, e.g. for
+     * a large head, so that the memory it holds is counted with the pool.
+     * @param old_size: The previous size of the buffer, 0 if it was pooled.
+     * @param size: The new size of the buffer, 0 once it is freed.
+     */
+    void track_large(size_t old_size, size_t size);
+
+    size_t buffer_size() const;
+
+    // The number of buffers borrowed.
+    uint64_t borrowed() const;
+    // The bytes mapped for the buffers, and how many of them are huge pages.
+    uint64_t mapped() const;
+    uint64_t huge_mapped() const;
+    // The bytes of the buffers grown out of the pool.
+    uint64_t large() const;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __EPOLL_HPP__
+#define __EPOLL_HPP__
+
+#include "def.hpp"
+#include <sys/epoll.h>
+#include <vector>
+#include <cstdint>
+
+class Epoll {
+private:
+    int epollfd_;
+
+public:
+    /*
+     * Constructor.
+     * Create a long-lived epoll instance.
+     * Throws std::runtime_error if the instance cannot be created.
+     */
+    Epoll();
+    ~Epoll();
+
+    Epoll(const Epoll &) = delete;
+    Epoll &operator=(const Epoll &) = delete;
+
+    /*
+     * Register a fd to the epoll instance.
+     * @param fd: The fd to watch.
+     * @param events: The epoll events to watch for.
+     * @param data: The user data returned together with the events.
+     * @return true if the fd is registered successfully, false otherwise.
+     */
+    bool add(int fd, uint32_t events, uint64_t data);
+
+    /*
+     * Modify (or re-arm) the events of a registered fd.
+     * @param fd: The fd to modify.
+     * @param events: The new epoll events.
+     * @param data: The user data returned together with the events.
+     * @return true if the fd is modified successfully, false otherwise.
+     */
+    bool modify(int fd, uint32_t events, uint64_t data);
+
+    /*
+     * Remove a fd from the epoll instance.
+     * @param fd: The fd to remove.
+     * @return true if the fd is removed successfully, false otherwise.
+     */
+    bool remove(int fd);
+
+    /*
+     * Wait for events.
+     * @param events: The buffer to store the ready events, its size is the
+     *                maximum number of events returned at once.
+     * @param timeout: The timeout in milliseconds, -1 to wait forever.
+     * @return The number of ready events, or -1 on error (EINTR is retried).
+     */
+    int wait(std::vector<epoll_event> &events, int timeout);
+};
+
+#endif
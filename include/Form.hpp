@@ -0,0 +1,69 @@
+#ifndef __FORM_HPP__
+#define __FORM_HPP__
+
+#include "def.hpp"
+#include "SmallVector.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+
+/*
+ * Decode the percent-encoded bytes of a url or form component.
+ * A malformed escape is kept as is, like the browsers do.
+ * @param encoded: The component.
+ * @param plus_as_space: Whether '+' stands for a space, as in a form.
+ * @param decoded: The string to append the decoded bytes to.
+ */
+void percent_decode(std::string_view encoded, bool plus_as_space, std::string &decoded);
+
+/*
+ * The fields of an application/x-www-form-urlencoded body or of a query
+ * string, e.g. "login=user&pass=p%40ss".
+ * The source is split on the first access only, and the names and values
+ * point into it. Only the ones holding an escape are decoded, once, into
+ * a string reserved for the whole source, so a plain form allocates
+ * nothing and the views stay valid as long as the source and the form.
+ */
+class Form {
+private:
+    struct Field {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    std::string_view source_;
+    bool plus_as_space_;
+    bool parsed_;
+    SmallVector<Field, INLINE_FORM_FIELD_NUM> fields_;
+    std::string decoded_;
+
+    void parse();
+    std::string_view decode(std::string_view encoded);
+
+public:
+    /*
+     * Constructor, nothing is parsed yet.
+     * @param source: The encoded fields, it outlives the form.
+     * @param plus_as_space: Whether '+' stands for a space, true for a body.
+     */
+    Form(std::string_view source = {}, bool plus_as_space = true);
+
+    Form(const Form &) = delete;
+    Form &operator=(const Form &) = delete;
+
+    /*
+     * Get the value of the first field of a name.
+     * A field without '=' has an empty value.
+     * @param name: The decoded name, compared exactly.
+     * @return The decoded value, or nullopt if there is no such field.
+     */
+    std::optional<std::string_view> get(std::string_view name);
+
+    // The fields in order, decoded. The index of name and value must be
+    // below size().
+    size_t size();
+    std::string_view name(size_t index);
+    std::string_view value(size_t index);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef __HEADERS_HPP__
+#define __HEADERS_HPP__
+
+#include "def.hpp"
+#include "SmallVector.hpp"
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// The header names known to the server, interned as they are parsed or set
+// so that they are found without comparing strings.
+enum class HeaderNames : uint8_t {
+    OTHER=0,
+    ACCEPT_ENCODING,
+    ACCEPT_RANGES,
+    ALLOW,
+    CACHE_CONTROL,
+    CONNECTION,
+    CONTENT_ENCODING,
+    CONTENT_LENGTH,
+    CONTENT_RANGE,
+    CONTENT_TYPE,
+    DATE,
+    ETAG,
+    EXPECT,
+    HOST,
+    IF_MODIFIED_SINCE,
+    IF_NONE_MATCH,
+    IF_RANGE,
+    LAST_MODIFIED,
+    RANGE,
+    SERVER,
+    TRANSFER_ENCODING,
+    VARY
+};
+
+#define HEADER_NAME_NUM 22
+
+/*
+ * Intern a header name, compared case-insensitively.
+ * @param name: The name.
+ * @return The known name, or OTHER.
+ */
+HeaderNames intern_header(std::string_view name);
+
+/*
+ * Get the canonical spelling of a known header name.
+ * @param name: The known name.
+ * @return The name, e.g. "Content-Length", empty for OTHER.
+ */
+std::string_view header_name_to_string(HeaderNames name);
+
+/*
+ * The headers of a message, in order.
+ * The headers are kept as serialized lines ("Name: value\r\n") in a single
+ * string, so a message with a few headers takes one allocation for all of
+ * them and a response sends them with one iovec. The lines are indexed by
+ * a small vector of offsets, and the first line of every known name by
+ * an array, so a known header is found in O(1) and the others by a scan
+ * comparing the names case-insensitively.
+ * A known name is written in its canonical spelling.
+ */
+class Headers {
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t value_length;
+        uint16_t name_length;
+        HeaderNames name;
+    };
+
+    std::string lines_;
+    SmallVector<Entry, INLINE_HEADER_NUM> entries_;
+    // The index of the first line of every known name plus one, 0 if none.
+    uint16_t known_[HEADER_NAME_NUM];
+
+    /*
+     * Find a header by name.
+     * @param name: The name, interned as known.
+     * @param spelling: The name, compared if it is not known.
+     * @return The index of the first line, or size() if none.
+     */
+    size_t find(HeaderNames name, std::string_view spelling) const;
+
+    /*
+     * Replace the value of a line, the lines after it are shifted.
+     * @param index: The index of the line.
+     * @param value: The new value.
+     */
+    void replace(size_t index, std::string_view value);
+
+public:
+    Headers();
+    Headers(std::initializer_list<std::pair<std::string_view, std::string_view> > headers);
+
+    /*
+     * Make room for the headers of a message, e.g. the parsed ones.
+     * @param num: The number of headers.
+     * @param size: The size of their names and values.
+     */
+    void reserve(size_t num, size_t size);
+
+    /*
+     * Append a header, even if there is one of the same name.
+     * @param name: The name interned, OTHER if not known.
+     * @param spelling: The name as sent, kept if it is not known.
+     * @param value: The value.
+     */
+    void add(HeaderNames name, std::string_view spelling, std::string_view value);
+    void add(std::string_view name, std::string_view value);
+
+    /*
+     * Set a header, replacing the value of the first one of the same name
+     * in place, or appending it.
+     * @param name: The name.
+     * @param value: The value.
+     */
+    void set(HeaderNames name, std::string_view value);
+    void set(std::string_view name, std::string_view value);
+
+    /*
+     * Get the value of the first header of a name.
+     * @param name: The name.
+     * @return The value, pointing into the headers, or nullopt if none.
+     */
+    std::optional<std::string_view> get(HeaderNames name) const;
+    std::optional<std::string_view> get(std::string_view name) const;
+
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+
+    // The header at an index, in order.
+    HeaderNames name_id(size_t index) const;
+    std::string_view name(size_t index) const;
+    std::string_view value(size_t index) const;
+
+    /*
+     * Get the serialized headers.
+     * @return The lines, each of them ends with "\r\n".
+     */
+    std::string_view lines() const;
+};
+
+#endif
@@ -2,16 +2,30 @@
 #define __MESSAGE_HPP__
 
 #include "def.hpp"
+#include "Headers.hpp"
 #include <vector>
-#include <unordered_map>
+#include <optional>
 #include <string>
+#include <memory>
+#include <string_view>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 enum class StatusCodes {
     UNKNOWN=-1,
+    CONTINUE=100,
     OK=200,
+    PARTIAL_CONTENT=206,
+    NOT_MODIFIED=304,
     BAD_REQUEST=400,
     FORBIDDEN=403,
     NOT_FOUND=404,
+    METHOD_NOT_ALLOWED=405,
+    CONTENT_TOO_LARGE=413,
+    UNSUPPORTED_MEDIA_TYPE=415,
+    RANGE_NOT_SATISFIABLE=416,
+    EXPECTATION_FAILED=417,
     INTERNAL_SERVER_ERROR=500
 };
 
@@ -21,60 +35,204 @@ enum class MethodTypes {
     POST=1
 };
 
-std::string status_code_to_string(const StatusCodes& status_code);
+// The content codings of a response body, in the order of preference.
+enum class Encodings {
+    IDENTITY=0,
+    GZIP=1,
+    BROTLI=2
+};
+
+#define ENCODING_NUM 3
+
+const std::string& status_code_to_string(const StatusCodes& status_code);
 std::string method_type_to_string(const MethodTypes& method_type);
 
+/*
+ * @brief Get the status line of a response from a static table
+ * HTTP/1.0 requests get an HTTP/1.0 status line, any other version
+ * gets an HTTP/1.1 one.
+ * @param status_code HTTP status code
+ * @param version HTTP version of the request
+ * @return std::string_view The status line, e.g. "HTTP/1.1 200 OK\r\n"
+ */
+std::string_view status_line(const StatusCodes& status_code, const std::string& version);
+
+/*
+ * @brief Get the Date and Server header lines of a response
+ * The lines are regenerated at most once per second and shared by all
+ * the threads, the returned pointer keeps them alive as long as needed.
+ * @return std::shared_ptr<const std::string> The lines, e.g.
+ * "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\nServer: zjucn-webserver\r\n"
+ */
+std::shared_ptr<const std::string> date_header();
+
+/*
+ * @brief Format a time as an HTTP date (an IMF-fixdate of RFC 9110)
+ * @param time The time
+ * @return std::string The date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+ */
+std::string http_date(time_t time);
+
+/*
+ * @brief Parse an HTTP date, only the IMF-fixdate format is accepted
+ * @param date The date
+ * @param time The parsed time
+ * @return bool Whether the date is valid
+ */
+bool parse_http_date(std::string_view date, time_t& time);
+
+// A range of the bytes of a body.
+struct ByteRange {
+    size_t offset;
+    size_t length;
+};
+
+/*
+ * @brief Parse the Range header of a request (RFC 9110 14.2)
+ * Only the bytes unit is supported, e.g. "bytes=0-499, 1000-, -200".
+ * The ranges starting after the end of the body are skipped and the others
+ * are clipped to it, at most MAX_RANGE_NUM ranges are accepted.
+ * @param range The value of the header
+ * @param size The size of the body
+ * @param ranges The satisfiable ranges, in the order of the header
+ * @return bool Whether the header is valid, it is ignored otherwise; it is
+ * valid but not satisfiable if no range is appended
+ */
+bool parse_range(std::string_view range, size_t size, std::vector<ByteRange>& ranges);
+
+/*
+ * @brief Get the name of a content coding, as in Content-Encoding
+ * @param encoding The content coding
+ * @return const std::string& The name, e.g. "gzip"
+ */
+const std::string& encoding_to_string(const Encodings& encoding);
+
+/*
+ * @brief Parse the Accept-Encoding header of a request
+ * The codings with q=0 are refused, "*" stands for the codings not listed,
+ * and identity is accepted unless it is refused.
+ * @param accept_encoding The value of the header
+ * @return unsigned The accepted codings as a bitmask of 1 << Encodings
+ */
+unsigned accept_encodings(std::string_view accept_encoding);
+
+/*
+ * A response body streamed from a file with sendfile instead of held in memory.
+ * The owner keeps the fd open as long as the body is referenced.
+ */
+struct FileBody {
+    std::shared_ptr<const void> owner;
+    int fd = -1;
+    off_t offset = 0;
+    size_t length = 0;
+};
+
+/*
+ * A response body borrowed from memory owned by someone else, e.g. a cached asset.
+ * The owner keeps the memory alive as long as the body is referenced.
+ */
+struct SharedBody {
+    std::shared_ptr<const void> owner;
+    const char *data = nullptr;
+    size_t size = 0;
+};
+
+/*
+ * A part of a response body after the in-memory or shared body, e.g. a part
+ * of a multipart/byteranges body: its head, then a range of memory or a file.
+ */
+struct BodyPart {
+    std::string head;
+    SharedBody shared_body;
+    FileBody file_body;
+};
+
+/*
+ * A file range of a serialized response, sent right before the iovec at
+ * the position (after the last iovec if it is the size of the list).
+ */
+struct FilePart {
+    size_t position;
+    FileBody file_body;
+};
+
 class Message {
-private:
+protected:
     std::string version_;
     std::string body_;
-    std::unordered_map<std::string, std::string> headers_;
+    Headers headers_;
 
 public:
     Message() = delete;
 
     /*
      * @brief Construct a new Message object
+     * The arguments are taken by value, pass them with std::move to move
+     * them into the message instead of copying them.
      * @param version HTTP version
      * @param body HTTP body
      * @param headers HTTP headers
      */
     Message(
-        const std::string& version,
-        const std::string& body,
-        const std::unordered_map<std::string, std::string>& headers
+        std::string version,
+        std::string body,
+        Headers headers
     );
 
     /*
      * @brief Construct a new Message object
      * @param other Message object to copy
      */
-    Message(const Message& other);
+    Message(const Message& other) = default;
+
+    /*
+     * @brief Construct a new Message object
+     * @param other Message object to move from
+     */
+    Message(Message&& other) = default;
 
     /*
      * @brief Destroy the Message object
      */
-    ~Message();
+    ~Message() = default;
 
     /*
      * @brief Get the version object
-     * @return std::string HTTP version
+     * @return const std::string& HTTP version
      */
-    std::string get_version() const;
+    const std::string& get_version() const;
 
     /*
      * @brief Get the body object
-     * @return std::string HTTP body
+     * @return const std::string& HTTP body
+     */
+    const std::string& get_body() const;
+
+    /*
+     * @brief Append bytes to the body, e.g. a request body as it arrives
+     * @param chunk The bytes to append
      */
-    std::string get_body() const;
+    void append_body(std::string_view chunk);
 
     /*
      * @brief Get the headers object
-     * @return std::unordered_map<std::string, std::string> HTTP headers
+     * @return const Headers& HTTP headers, in order
      */
-    std::unordered_map<std::string, std::string> get_headers() const;
+    const Headers& get_headers() const;
 
-    Message& operator=(const Message& other);
+    /*
+     * @brief Get the value of the first header of a name
+     * A known name is found without comparing strings, another name is
+     * compared case-insensitively.
+     * @param name The name of the header
+     * @return std::optional<std::string_view> The value, pointing into the
+     * message, nullopt if the header is absent
+     */
+    std::optional<std::string_view> get_header(HeaderNames name) const;
+    std::optional<std::string_view> get_header(std::string_view name) const;
+
+    Message& operator=(const Message& other) = default;
+    Message& operator=(Message&& other) = default;
 };
 
 class Request : public Message {
@@ -93,23 +251,29 @@ public:
      * @param headers HTTP headers
      */
     Request(
-        const MethodTypes& method_type,
-        const std::string& url,
-        const std::string& version,
-        const std::string& body,
-        const std::unordered_map<std::string, std::string>& headers
+        MethodTypes method_type,
+        std::string url,
+        std::string version,
+        std::string body,
+        Headers headers
     );
 
     /*
      * @brief Construct a new Request object
      * @param other Request object to copy
      */
-    Request(const Request& other);
+    Request(const Request& other) = default;
+
+    /*
+     * @brief Construct a new Request object
+     * @param other Request object to move from
+     */
+    Request(Request&& other) = default;
 
     /*
      * @brief Destroy the Request object
      */
-    ~Request();
+    ~Request() = default;
 
     /*
      * @brief Get the method type object
@@ -119,9 +283,17 @@ public:
 
     /*
      * @brief Get the url object
-     * @return std::string HTTP url
+     * @return const std::string& HTTP url
+     */
+    const std::string& get_url() const;
+
+    /*
+     * @brief Check whether the client wants to keep the connection open
+     * HTTP/1.1 keeps the connection alive unless "Connection: close" is sent,
+     * HTTP/1.0 closes it unless "Connection: keep-alive" is sent.
+     * @return bool Whether the connection should be kept alive
      */
-    std::string get_url() const;
+    bool is_keep_alive() const;
 
     /*
      * @brief Convert the Request object to a string
@@ -129,39 +301,54 @@ public:
      */
     std::string to_string() const;
 
-    Request& operator=(const Request& other);
+    Request& operator=(const Request& other) = default;
+    Request& operator=(Request&& other) = default;
 };
 
 class Response : public Message {
 private:
     StatusCodes status_code_;
+    // Pre-serialized status line and headers, sent instead of serializing.
+    SharedBody head_;
+    SharedBody shared_body_;
+    FileBody file_body_;
+    std::vector<BodyPart> parts_;
+    std::shared_ptr<const std::string> date_;
 public:
     Response();
 
     /*
      * @brief Construct a new Response object
+     * The headers and the body may also be set afterwards with the
+     * setters, which return the response so that they can be chained.
      * @param status_code HTTP status code
      * @param version HTTP version
      * @param headers HTTP headers
      * @param body HTTP body
      */
     Response(
-        const StatusCodes& status_code,
-        const std::string& version,
-        const std::unordered_map<std::string, std::string>& headers,
-        const std::string& body
+        StatusCodes status_code,
+        std::string version,
+        Headers headers = {},
+        std::string body = ""
     );
 
     /*
      * @brief Construct a new Response object
      * @param other Response object to copy
      */
-    Response(const Response& other);
+    Response(const Response& other) = default;
+
+    /*
+     * @brief Construct a new Response object
+     * @param other Response object to move from
+     */
+    Response(Response&& other) = default;
 
     /*
      * @brief Destroy the Response object
      */
-    ~Response();
+    ~Response() = default;
 
     /*
      * @brief Get the status code object
@@ -170,11 +357,72 @@ public:
     StatusCodes get_status_code() const;
 
     /*
-     * @brief Serialize the Response object
-     * @param buffer The buffer to serialize the Response object to
-     * @return ssize_t The number of bytes serialized
+     * @brief Set a header, replacing its previous value in place
+     * The headers are sent in the order they are first set.
+     * @param name The name of the header
+     * @param value The value of the header
+     * @return Response& This response
      */
-    ssize_t serialize(std::vector<uint8_t>& buffer) const;
+    Response& set_header(HeaderNames name, std::string_view value);
+    Response& set_header(std::string_view name, std::string_view value);
+
+    /*
+     * @brief Set the in-memory body
+     * @param body HTTP body
+     * @return Response& This response
+     */
+    Response& set_body(std::string body);
+
+    /*
+     * @brief Send pre-serialized bytes as the status line and headers
+     * The bytes are sent as is, followed by the Date and Server headers,
+     * the empty line and the body, the headers object is ignored.
+     * @param head The status line and headers, each line ends with "\r\n"
+     * @return Response& This response
+     */
+    Response& set_head(SharedBody head);
+
+    /*
+     * @brief Send borrowed memory as the body instead of the in-memory body
+     * The memory is referenced by the serialized iovecs, it is not copied.
+     * @param shared_body The memory to send after the headers
+     * @return Response& This response
+     */
+    Response& set_shared_body(SharedBody shared_body);
+
+    /*
+     * @brief Stream the body from a file instead of the in-memory body
+     * The Content-Length header must be set to the length of the file body.
+     * @param file_body The file range to send after the headers
+     * @return Response& This response
+     */
+    Response& set_file_body(FileBody file_body);
+
+    /*
+     * @brief Get the file body object
+     * @return const FileBody& The file body, its fd is -1 if there is none
+     */
+    const FileBody& get_file_body() const;
+
+    /*
+     * @brief Send more parts after the body
+     * The Content-Length header must include the parts.
+     * @param parts The parts to send after the body, in order
+     * @return Response& This response
+     */
+    Response& set_parts(std::vector<BodyPart> parts);
+
+    /*
+     * @brief Serialize the Response object as a scatter-gather list
+     * The iovecs point to the status line table, the header lines and
+     * the body of this object, which must outlive them and stay unmodified.
+     * The file ranges are not serialized and have to be sent separately.
+     * @param iov The list to append the iovecs to
+     * @param files The list to append the file ranges to, with their
+     * positions in iov, nullptr to skip them
+     * @return size_t The number of bytes referenced by the appended iovecs
+     */
+    size_t serialize(std::vector<iovec>& iov, std::vector<FilePart>* files = nullptr) const;
 
     /*
      * @brief Convert the Response object to a string
@@ -182,7 +430,53 @@ public:
      */
     std::string to_string() const;
 
-    Response& operator=(const Response& other);
+    Response& operator=(const Response& other) = default;
+    Response& operator=(Response&& other) = default;
+};
+
+/*
+ * A fixed response (e.g. an error page) serialized once.
+ * The status line and headers are pre-serialized for HTTP/1.0 and HTTP/1.1
+ * and for both values of the Connection header, so answering with it is
+ * only a matter of pointing the iovecs at the bytes.
+ */
+class CannedResponse {
+private:
+    StatusCodes status_code_;
+    // The heads and the body, in one block referenced by the responses.
+    std::shared_ptr<const std::string> block_;
+    // [HTTP/1.0, HTTP/1.1][close, keep-alive]
+    std::string_view heads_[2][2];
+    std::string_view body_;
+
+public:
+    /*
+     * @brief Construct a new CannedResponse object
+     * Content-Length and Connection are added to the headers.
+     * @param status_code HTTP status code
+     * @param headers HTTP headers
+     * @param body HTTP body
+     */
+    CannedResponse(
+        const StatusCodes& status_code,
+        const Headers& headers,
+        const std::string& body
+    );
+
+    /*
+     * @brief Get the status code object
+     * @return StatusCodes HTTP status code
+     */
+    StatusCodes get_status_code() const;
+
+    /*
+     * @brief Make a response referencing the pre-serialized bytes
+     * Nothing is copied or serialized, the response shares the bytes.
+     * @param version HTTP version of the request
+     * @param keep_alive Whether the connection is kept open
+     * @return Response The response to send
+     */
+    Response respond(const std::string& version, bool keep_alive) const;
 };
 
 #endif
@@ -0,0 +1,94 @@
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * A counter written by a single thread and read by any thread.
+ * The owner updates it with a relaxed load and store, so there is no
+ * locked instruction and no shared cache line on the hot path, the readers
+ * see a recent value.
+ */
+class Counter {
+private:
+    std::atomic<uint64_t> value_;
+
+public:
+    Counter() : value_(0) {}
+
+    /*
+     * Add to the counter, called by the owner thread only.
+     * @param n: The value to add.
+     */
+    void add(uint64_t n = 1) {
+        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /*
+     * Set the counter (e.g. a gauge), called by the owner thread only.
+     * @param value: The new value.
+     */
+    void set(uint64_t value) {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+};
+
+/*
+ * An HDR-style histogram of values (e.g. latencies in ns).
+ * The values are bucketed log-linearly: every power of two is split into
+ * 2^SUB_BITS buckets, so a value is known within 1 / 2^SUB_BITS (~3%),
+ * whatever its magnitude, with a fixed number of buckets.
+ * Recording follows the rules of Counter: one writer thread, any reader.
+ * Readers merge the histograms of the writers into their own and read
+ * the percentiles from it.
+ */
+class Histogram {
+public:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int MAX_BITS = 40;  // larger values are clamped
+    static constexpr int BUCKET_NUM = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+private:
+    Counter buckets_[BUCKET_NUM];
+    Counter count_;
+    Counter max_;
+
+    static int bucket_of(uint64_t value);
+    static uint64_t value_of(int bucket);
+
+public:
+    Histogram() {}
+
+    Histogram(const Histogram &) = delete;
+    Histogram &operator=(const Histogram &) = delete;
+
+    /*
+     * Record a value, called by the owner thread only.
+     * @param value: The value to record.
+     */
+    void record(uint64_t value);
+
+    /*
+     * Add the values of another histogram to this one.
+     * This histogram must not be shared, the other one may be recording.
+     * @param other: The histogram to merge.
+     */
+    void merge(const Histogram &other);
+
+    /*
+     * Get the value at a percentile.
+     * @param percentile: The percentile in [0, 100].
+     * @return The value (the middle of its bucket), or 0 if empty.
+     */
+    uint64_t percentile(double percentile) const;
+
+    uint64_t count() const;
+    uint64_t max() const;
+};
+
+#endif
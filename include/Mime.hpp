@@ -0,0 +1,15 @@
+#ifndef __MIME_HPP__
+#define __MIME_HPP__
+
+#include <string>
+#include <string_view>
+
+/*
+ * Get the media type of a file from its extension, case-insensitively.
+ * @param path: The path or the url of the file.
+ * @return The value of the Content-Type header,
+ * "application/octet-stream" if the extension is unknown.
+ */
+const std::string &mime_type(std::string_view path);
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __PARSER_HPP__
+#define __PARSER_HPP__
+
+#include "def.hpp"
+#include "Headers.hpp"
+#include <cstdint>
+#include <string_view>
+
+enum class ParseStatus {
+    INCOMPLETE, // More bytes are needed, call parse again once they arrive.
+    COMPLETE,   // The request line and the headers are parsed.
+    ERROR       // The request is malformed.
+};
+
+enum class DecodeStatus {
+    INCOMPLETE, // More bytes are needed, call decode again once they arrive.
+    COMPLETE,   // The body is over.
+    ERROR       // The chunked framing is malformed.
+};
+
+/*
+ * A resumable HTTP/1.x request head parser.
+ * It works in place over the bytes of a receive buffer: every call is given
+ * the start of the request and the number of bytes received so far, and the
+ * scan resumes where the previous call stopped, so no byte is scanned twice.
+ * The parsed parts are kept as offsets from the start of the request, so the
+ * buffer may be moved or grown between calls, and they are returned as
+ * string_views over the bytes given to the last call. Nothing is allocated.
+ * The body is left to a BodyDecoder, set up from content_length and chunked.
+ */
+class RequestParser {
+private:
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct Header {
+        Span name;
+        Span value;
+    };
+
+    enum class State {
+        REQUEST_LINE,
+        HEADERS,
+        COMPLETE,
+        ERROR
+    };
+
+    State state_;
+    // Start of the line being parsed and where the scan for its end resumes.
+    size_t line_start_;
+    size_t scan_pos_;
+    const char *data_;
+
+    Span method_;
+    Span target_;
+    Span version_;
+    Header headers_[MAX_HEADER_NUM];
+    // The names interned as they are parsed.
+    HeaderNames header_ids_[MAX_HEADER_NUM];
+    size_t header_num_;
+    size_t head_length_;
+    size_t content_length_;
+    bool has_content_length_;
+    bool chunked_;
+
+    std::string_view view(const Span &span) const;
+    bool parse_request_line(size_t end);
+    bool parse_header(size_t end);
+
+public:
+    RequestParser();
+
+    /*
+     * Forget the parsed request and get ready for the next one.
+     */
+    void reset();
+
+    /*
+     * Parse the bytes received so far.
+     * @param data: The start of the request.
+     * @param size: The number of bytes available from data.
+     * @return The status of the request.
+     */
+    ParseStatus parse(const char *data, size_t size);
+
+    std::string_view method() const;
+    std::string_view target() const;
+    std::string_view version() const;
+    size_t header_num() const;
+    HeaderNames header_id(size_t index) const;
+    std::string_view header_name(size_t index) const;
+    std::string_view header_value(size_t index) const;
+
+    /*
+     * Get the number of bytes of the request line and the headers,
+     * the body starts right after them.
+     * Only meaningful once the head is complete.
+     */
+    size_t head_length() const;
+
+    /*
+     * Get the length of the body given by Content-Length, 0 if none.
+     */
+    size_t content_length() const;
+
+    /*
+     * Check whether the body is sent with the chunked transfer coding.
+     */
+    bool chunked() const;
+};
+
+/*
+ * A resumable request body decoder.
+ * The body is framed either by Content-Length or by the chunked transfer
+ * coding. Every call is given the bytes received after what the previous
+ * calls consumed, it consumes the framing as it goes and hands out the data
+ * in place, so the body is never buffered whole and nothing is copied.
+ * The chunk extensions and the trailer fields are skipped.
+ */
+class BodyDecoder {
+private:
+    enum class State {
+        LENGTH,         // The rest of a Content-Length body.
+        SIZE,           // The hex size of a chunk.
+        EXTENSION,      // The extensions after the size, up to the LF.
+        DATA,           // The data of a chunk.
+        DATA_END,       // The CRLF after the data of a chunk.
+        TRAILER,        // The trailer fields, up to an empty line.
+        COMPLETE,
+        ERROR
+    };
+
+    State state_;
+    // The bytes left in the body or in the chunk.
+    size_t remaining_;
+    // The hex digits of the size, or the bytes of the current trailer line.
+    size_t digits_;
+    // The bytes of the size line or of the trailer, up to MAX_CHUNK_LINE_SIZE.
+    size_t line_size_;
+
+public:
+    BodyDecoder();
+
+    /*
+     * Get ready for the body of a request.
+     * @param content_length: The length of the body, if not chunked.
+     * @param chunked: Whether the body is chunked.
+     */
+    void reset(size_t content_length, bool chunked);
+
+    /*
+     * Decode the bytes received so far, up to the end of the next data.
+     * @param data: The bytes following the consumed ones.
+     * @param size: The number of bytes available from data.
+     * @param used: The number of bytes consumed.
+     * @param chunk: The data decoded, in place, possibly empty.
+     * @return The status of the body, the data is valid in any case.
+     */
+    DecodeStatus decode(const char *data, size_t size, size_t &used, std::string_view &chunk);
+
+    /*
+     * Check whether the whole body is decoded.
+     */
+    bool complete() const;
+};
+
+#endif
@@ -2,42 +2,144 @@
 #define __RECEIVER_HPP__
 
 #include "def.hpp"
+#include "BufferPool.hpp"
 #include "Message.hpp"
-#include <mutex>
-#include <sys/epoll.h>
-#include <queue>
-#include <atomic>
+#include "Parser.hpp"
+#include <vector>
+#include <string>
+
+enum class ReceiveStatus {
+    RECEIVED,   // Some bytes are appended to the receive buffer.
+    FULL,       // The receive buffer is full, its bytes must be consumed first.
+    AGAIN,      // Nothing to read for now, wait for the next readiness event.
+    CLOSED,     // The peer has performed an orderly shutdown.
+    ERROR       // recv failed.
+};
+
+enum class ReceiveStage {
+    IDLE,       // No byte of the next request is received.
+    HEADERS,    // The request line or the headers are incomplete.
+    BODY        // The headers are complete, the body is not.
+};
+
+enum class BodyStatus {
+    DATA,       // A piece of the body is decoded.
+    AGAIN,      // More bytes are needed for the rest of the body.
+    COMPLETE,   // The body is over, the next request may be received.
+    ERROR       // The body is malformed.
+};
 
 class Receiver {
 private:
-    std::mutex mutex_;
     int sockfd_;
-    std::atomic<bool> running_;
-    std::vector<uint8_t> buffer_;
-    // It seems that message_queue_ is not needed
-    // to be protected by another mutex.
-    std::string remaining_;
+    BufferPool &pool_;
+    // The bytes in [begin_, end_) are received but not yet consumed,
+    // the request being parsed starts at begin_.
+    // The buffer is borrowed from the pool when bytes arrive and given back
+    // once they are consumed. A head larger than a pooled buffer is moved
+    // to large_, which grows up to MAX_REQUEST_SIZE, a body is consumed
+    // one buffer at a time instead.
+    char *buffer_;
+    size_t capacity_;
+    std::vector<char> large_;
+    size_t begin_;
+    size_t end_;
+    RequestParser parser_;
+    BodyDecoder decoder_;
+    // The head of a request is received, its body is being decoded.
+    bool in_body_;
+
+    /*
+     * Make room after the received bytes: borrow the buffer if none is
+     * held, or move the pending bytes to the front if it is full.
+     * @return false if no buffer can be borrowed.
+     */
+    bool make_room();
 
 public:
     Receiver() = delete;
     /*
      * Constructor.
-     * @param sockfd: The sockfd to receive messages on.
+     * @param sockfd: The non-blocking sockfd to receive messages on.
+     * @param pool: The pool to borrow the receive buffer from, it outlives
+     * the receiver.
      */
-    Receiver(int sockfd);
+    Receiver(int sockfd, BufferPool &pool);
     ~Receiver();
 
+    Receiver(const Receiver &) = delete;
+    Receiver &operator=(const Receiver &) = delete;
+
+    /*
+     * Drain the socket into the receive buffer without blocking.
+     * The buffer is borrowed if none is held. The socket is not read past a
+     * full buffer: the caller consumes it with get_request and get_body
+     * (get_request grows it for a large head) and receives again, so a body
+     * is passed on one buffer at a time.
+     * @return The status of the socket after draining, FULL if the buffer
+     * is full, ERROR if no buffer can be borrowed.
+     */
+    ReceiveStatus receive();
+
+    /*
+     * Append bytes received by the caller, e.g. in a buffer provided to
+     * io_uring, to the receive buffer, as far as they fit.
+     * @param data: The bytes.
+     * @param size: The number of bytes.
+     * @param used: The number of bytes appended.
+     * @return RECEIVED if every byte is appended, FULL if the buffer is
+     * full and must be consumed (or grown) first, ERROR if no buffer can
+     * be borrowed.
+     */
+    ReceiveStatus receive(const char *data, size_t size, size_t &used);
+
     /*
-     * Close the receiver.
+     * Grow the buffer out of the pool, up to MAX_REQUEST_SIZE, for bytes
+     * which cannot be consumed yet, e.g. a head larger than a pooled
+     * buffer. The bytes are kept at their offsets.
+     * @return false if no buffer is held or it is at the limit.
      */
-    void close();
+    bool grow();
 
     /*
-     * Receive a message.
-     * @param request: The request to receive.
-     * @return true if the message is received successfully, false otherwise.
+     * Drain the socket and drop the bytes, e.g. a refused request body.
+     * The bytes received but not consumed are dropped too.
+     * @return The status of the socket after draining.
+     */
+    ReceiveStatus discard();
+
+    /*
+     * Parse the head of the next request from the receive buffer, its body
+     * is then received with get_body until it is complete.
+     * A malformed or too large head is returned with an UNKNOWN method.
+     * @param request: The request to receive, without its body.
+     * @return true if a head is parsed, false if more bytes are needed or
+     * the body of the previous request is not yet received.
      */
     bool get_request(Request &request);
+
+    /*
+     * Decode the next piece of the body of the request from the receive
+     * buffer. The piece points into the buffer, it is only valid until the
+     * next call to receive.
+     * @param chunk: The piece of the body, set if DATA is returned.
+     * @return The status of the body, ERROR too if a full buffer cannot be
+     * decoded, e.g. a chunk size line longer than a buffer.
+     */
+    BodyStatus get_body(std::string_view &chunk);
+
+    /*
+     * Give the receive buffer back if every received byte is consumed,
+     * so that an idle connection holds no buffer. The pieces of the body
+     * returned by get_body are no longer valid.
+     */
+    void release_buffer();
+
+    /*
+     * Get how far the next request is received, as of the last get_request.
+     * @return The stage of the next request.
+     */
+    ReceiveStage stage() const;
 };
 
 #endif
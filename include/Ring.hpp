@@ -0,0 +1,97 @@
+#ifndef __RING_HPP__
+#define __RING_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/*
+ * A bounded lock-free single-producer single-consumer ring.
+ * One thread pushes and one other thread pops, neither of them ever blocks
+ * or allocates. The indices only grow, the capacity is a power of two so
+ * the slot of an index is index & mask. Each side caches the last index
+ * seen of the other side, so the shared cache lines are only touched when
+ * the ring looks full (producer) or empty (consumer).
+ */
+template <typename T>
+class Ring {
+private:
+    std::unique_ptr<T[]> slots_;
+    size_t mask_;
+    // Written by the consumer.
+    alignas(64) std::atomic<size_t> head_;
+    size_t cached_tail_;
+    // Written by the producer.
+    alignas(64) std::atomic<size_t> tail_;
+    size_t cached_head_;
+
+public:
+    /*
+     * Constructor.
+     * @param capacity: The maximum number of elements, rounded up to a power of two.
+     */
+    explicit Ring(size_t capacity) : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_ = std::unique_ptr<T[]>(new T[size]);
+        mask_ = size - 1;
+    }
+    ~Ring() {}
+
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+
+    /*
+     * Push an element, called by the producer only.
+     * @param value: The element to push.
+     * @return false if the ring is full, true otherwise.
+     */
+    bool push(const T &value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Pop an element, called by the consumer only.
+     * @param value: The popped element.
+     * @return false if the ring is empty, true otherwise.
+     */
+    bool pop(T &value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+        value = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Get the number of elements, exact only if called by the producer
+     * or the consumer, a snapshot otherwise.
+     */
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : 0;
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+};
+
+#endif
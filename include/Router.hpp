@@ -0,0 +1,104 @@
+#ifndef __ROUTER_HPP__
+#define __ROUTER_HPP__
+
+#include "Message.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class MountTypes {
+    EXACT,  // Only the url itself.
+    PREFIX  // Every url starting with it, e.g. "/static/" for a directory.
+};
+
+enum class RouteStatus {
+    FOUND,
+    NOT_FOUND,
+    METHOD_NOT_ALLOWED  // The url is routed, but not for the method.
+};
+
+struct RouteMatch {
+    uint16_t id = 0;
+    // The url without the query string.
+    std::string_view path;
+    // The part of the path after the mounted url, empty for an exact route.
+    std::string_view rest;
+    // The methods routed for the url as a bitmask of 1 << MethodTypes,
+    // set when the method is not allowed.
+    unsigned allowed = 0;
+};
+
+/*
+ * A radix tree router.
+ * The urls are stored in a tree whose edges are labelled with the common
+ * prefixes of the urls, a lookup walks down the tree once and keeps the
+ * longest prefix route met on the way. Every node holds a route id per
+ * method for the exact url and for the urls under it.
+ * The exact routes are also put in a perfect hash table when the router is
+ * built, so a lookup of a known url is one hash and one comparison.
+ * The router is read-only once built, so it is shared without locking.
+ */
+class Router {
+public:
+    static constexpr int METHOD_NUM = 2;
+
+private:
+    struct Node {
+        std::string label;
+        std::vector<std::unique_ptr<Node> > children;
+        // Route ids per method, 0 if none.
+        uint16_t exact[METHOD_NUM] = {};
+        uint16_t prefix[METHOD_NUM] = {};
+    };
+
+    struct Slot {
+        std::string url;
+        const Node *node = nullptr;
+    };
+
+    Node root_;
+    // The perfect hash of the exact routes: a url goes to a bucket, and the
+    // seed of the bucket sends it to a slot no other url is sent to.
+    std::vector<uint32_t> seeds_;
+    std::vector<Slot> slots_;
+
+    Node *insert(const std::string &url);
+    const Node *find_exact(std::string_view path) const;
+
+public:
+    Router() {}
+    ~Router() {}
+
+    Router(const Router &) = delete;
+    Router &operator=(const Router &) = delete;
+
+    /*
+     * Route a url for a method.
+     * Throws std::invalid_argument if it is already routed.
+     * @param method: The method.
+     * @param mount: Whether the url or every url under it is routed.
+     * @param url: The url, starting with '/'.
+     * @param id: The id reported by match, not 0.
+     */
+    void add(MethodTypes method, MountTypes mount, const std::string &url, uint16_t id);
+
+    /*
+     * Build the perfect hash of the exact routes, after the last add.
+     */
+    void build();
+
+    /*
+     * Find the route of a request target.
+     * The query string is ignored, an exact route is preferred to a prefix
+     * route, and the longest prefix route is preferred to the others.
+     * @param method: The method of the request.
+     * @param target: The request target.
+     * @param match: The matched route.
+     * @return Whether the target is routed for the method.
+     */
+    RouteStatus match(MethodTypes method, std::string_view target, RouteMatch &match) const;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __SCAN_HPP__
+#define __SCAN_HPP__
+
+#include "def.hpp"
+
+/*
+ * Byte scanning kernels used by the request parser.
+ * Every kernel returns the first matching byte in [begin, end), or end if
+ * there is none, and never reads outside of it. The implementation is
+ * selected at runtime from the cpu features (SSE2, then a scalar fallback)
+ * the first time a kernel is called, and can be overridden with scan_use,
+ * e.g. to use AVX2.
+ */
+
+enum class ScanIsa {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+/*
+ * Find the first byte equal to c.
+ */
+const char *scan_char(const char *begin, const char *end, char c);
+
+/*
+ * Find the first byte which is not a token char (RFC 9110),
+ * e.g. the ':' ending a header name or the ' ' ending a method.
+ */
+const char *scan_non_token(const char *begin, const char *end);
+
+/*
+ * Find the first byte which is SP, a control char or DEL,
+ * e.g. the ' ' ending a request target.
+ */
+const char *scan_non_vchar(const char *begin, const char *end);
+
+/*
+ * Find the first control char other than HTAB, or DEL,
+ * i.e. a byte not allowed in a header value.
+ */
+const char *scan_ctl(const char *begin, const char *end);
+
+/*
+ * Get the implementation used by default on the cpu. AVX2 is not: the
+ * fields of a request are mostly shorter than its 32 bytes, and it is not
+ * faster than SSE2 on them.
+ */
+ScanIsa scan_default_isa();
+
+/*
+ * Select the implementation of the kernels.
+ * @param isa: The implementation, it must be supported by the cpu.
+ * @return false if the cpu does not support it, true otherwise.
+ */
+bool scan_use(ScanIsa isa);
+
+/*
+ * Get the name of the selected implementation.
+ */
+const char *scan_isa_name();
+
+#endif
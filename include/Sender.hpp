@@ -3,28 +3,128 @@
 
 #include "def.hpp"
 #include "Message.hpp"
-#include <mutex>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <sys/uio.h>
+
+enum class SendStatus {
+    DONE,       // All the pending bytes are sent.
+    PENDING,    // The socket is full, wait for it to be writable.
+    ERROR       // send failed.
+};
 
 class Sender {
 private:
+    // A queued response, its iovecs point into the response itself, and
+    // iov_index with the adjusted head iovec is the cursor of a partial send.
+    // The file ranges are sent between the iovecs, in order, each of them
+    // advances its offset as it is sent.
+    struct Segment {
+        Response response;
+        std::vector<iovec> iov;
+        size_t iov_index = 0;
+        std::vector<FilePart> files;
+        size_t file_index = 0;
+
+        // The end of the iovecs to send before the next file range.
+        size_t iov_end() const {
+            return file_index < files.size() ? files[file_index].position : iov.size();
+        }
+
+        bool sent() const {
+            return iov_index == iov.size() && file_index == files.size();
+        }
+    };
+
     int sockfd_;
-    std::mutex mutex_;
-    std::vector<uint8_t> buffer_;
+    // Segments not yet accepted by the kernel, in order.
+    // std::deque never moves its elements, so the iovecs stay valid.
+    std::deque<Segment> queue_;
+    // The bytes queued and sent since the sender was created.
+    uint64_t queued_;
+    uint64_t sent_;
+
+    /*
+     * Advance the cursor over the bytes accepted by the kernel.
+     * @param size: The number of bytes sent.
+     */
+    void advance(size_t size);
+
+    /*
+     * Drop the segments sent completely.
+     */
+    void drop_sent();
 
 public:
     Sender() = delete;
     /*
      * Constructor.
-     * @param sockfd: The sockfd to send messages on.
+     * @param sockfd: The non-blocking sockfd to send messages on.
      */
     Sender(int sockfd);
     ~Sender();
 
+    /*
+     * Queue a response after the pending ones without sending it,
+     * so that pipelined responses go out with a single write on flush.
+     * @param response: The response to queue, it is moved into the queue.
+     * @return The number of bytes queued, headers and body.
+     */
+    size_t queue_response(Response &&response);
+
     /*
      * Send a response.
-     * @param response: The response to send.
+     * The bytes that cannot be sent right now are kept until flush.
+     * @param response: The response to send, it is moved into the queue.
+     * @return false if the socket fails, true otherwise.
+     */
+    bool send_response(Response &&response);
+
+    /*
+     * Send as many pending bytes as the socket accepts.
+     * The iovecs of the queued responses are gathered into one sendmsg, up
+     * to the next file range. The bytes before a file range (the headers,
+     * or the head of a part) are sent with MSG_MORE so that they are
+     * coalesced with the first bytes of the file sent by sendfile.
+     * @return The status after flushing.
+     */
+    SendStatus flush();
+
+    /*
+     * Gather the iovecs of the queued responses up to the next file range
+     * without sending them, e.g. to send them with io_uring. The bytes
+     * stay queued until complete is called.
+     * @param batch: The iovecs to fill.
+     * @param size: The number of iovecs batch holds.
+     * @param more: Set if a file range follows the gathered bytes.
+     * @return The number of iovecs gathered, 0 if a file range is next
+     * (sent by flush) or nothing is queued.
+     */
+    size_t gather(iovec *batch, size_t size, bool &more);
+
+    /*
+     * Advance over the bytes sent by the caller, in the order gathered.
+     * @param size: The number of bytes sent.
+     */
+    void complete(size_t size);
+
+    /*
+     * Check whether there are bytes waiting to be sent.
+     */
+    bool pending() const;
+
+    /*
+     * Get the number of bytes queued since the sender was created, i.e. the
+     * number sent once the last queued response is sent.
+     */
+    uint64_t queued() const;
+
+    /*
+     * Get the number of bytes accepted by the kernel since the sender was
+     * created, by flush or reported to complete.
      */
-    bool send_response(Response &response);
+    uint64_t sent() const;
 };
 
 #endif
@@ -0,0 +1,129 @@
+#ifndef __SLAB_HPP__
+#define __SLAB_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/*
+ * A table of objects addressed by 64-bit ids.
+ * The slots live in fixed-size pages which are never moved, so the objects
+ * keep their addresses and neighbouring ids share cache lines. Freed slots
+ * are kept in a free list, so both insertion and removal are O(1).
+ * An id is (generation << 32 | index), the generation of a slot is bumped
+ * whenever it is freed, so a stale id of a reused slot is never resolved.
+ * Generations start from 1, so a valid id is never 0.
+ * Not thread-safe, every reactor owns its own table.
+ */
+template <typename T, size_t PAGE_SIZE = 1024>
+class Slab {
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct Slot {
+        std::optional<T> value;
+        uint32_t generation = 1;
+        uint32_t next_free = NO_SLOT;
+    };
+
+    std::vector<std::unique_ptr<Slot[]> > pages_;
+    uint32_t free_head_;
+    uint32_t slot_num_;
+    size_t size_;
+    size_t capacity_;
+
+    Slot &slot(uint32_t index) {
+        return pages_[index / PAGE_SIZE][index % PAGE_SIZE];
+    }
+
+public:
+    static constexpr uint64_t INVALID_ID = 0;
+
+    /*
+     * Constructor.
+     * @param capacity: The maximum number of objects held at the same time.
+     */
+    explicit Slab(size_t capacity) :
+        free_head_(NO_SLOT), slot_num_(0), size_(0),
+        capacity_(capacity < NO_SLOT ? capacity : NO_SLOT - 1) {}
+    ~Slab() {}
+
+    Slab(const Slab &) = delete;
+    Slab &operator=(const Slab &) = delete;
+
+    /*
+     * Construct an object in a free slot.
+     * @param args: The arguments forwarded to the constructor of T.
+     * @return The id of the object, or INVALID_ID if the table is full.
+     */
+    template <typename... Args>
+    uint64_t emplace(Args &&...args) {
+        uint32_t index;
+        if (free_head_ != NO_SLOT) {
+            index = free_head_;
+            free_head_ = slot(index).next_free;
+        } else {
+            if (slot_num_ >= capacity_) {
+                return INVALID_ID;
+            }
+            if (slot_num_ % PAGE_SIZE == 0) {
+                pages_.emplace_back(new Slot[PAGE_SIZE]);
+            }
+            index = slot_num_++;
+        }
+        Slot &s = slot(index);
+        s.value.emplace(std::forward<Args>(args)...);
+        s.next_free = NO_SLOT;
+        size_++;
+        return (static_cast<uint64_t>(s.generation) << 32) | index;
+    }
+
+    /*
+     * Resolve an id.
+     * @param id: The id of the object.
+     * @return The object, or nullptr if the id is stale or invalid.
+     */
+    T *get(uint64_t id) {
+        uint32_t index = static_cast<uint32_t>(id);
+        if (index >= slot_num_) {
+            return nullptr;
+        }
+        Slot &s = slot(index);
+        if (s.generation != static_cast<uint32_t>(id >> 32) || !s.value) {
+            return nullptr;
+        }
+        return &*s.value;
+    }
+
+    /*
+     * Destroy an object and free its slot.
+     * @param id: The id of the object.
+     * @return true if the object is destroyed, false if the id is stale or invalid.
+     */
+    bool erase(uint64_t id) {
+        if (get(id) == nullptr) {
+            return false;
+        }
+        uint32_t index = static_cast<uint32_t>(id);
+        Slot &s = slot(index);
+        s.value.reset();
+        if (++s.generation == 0) {
+            s.generation = 1;
+        }
+        s.next_free = free_head_;
+        free_head_ = index;
+        size_--;
+        return true;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+};
+
+#endif
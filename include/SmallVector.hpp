@@ -0,0 +1,130 @@
+#ifndef __SMALL_VECTOR_HPP__
+#define __SMALL_VECTOR_HPP__
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+/*
+ * A vector keeping its first N values in place, so a short list takes no
+ * allocation and copying it is a memcpy. Once there are more than N values
+ * they move to the heap, whose capacity doubles, and stay there.
+ * Only for trivially copyable values, which are moved with memcpy.
+ */
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector: T must be trivially copyable");
+
+private:
+    T inline_[N];
+    std::unique_ptr<T[]> heap_;
+    size_t size_;
+    size_t capacity_;
+
+public:
+    SmallVector() : size_(0), capacity_(N) {}
+    ~SmallVector() {}
+
+    SmallVector(const SmallVector &other) : size_(0), capacity_(N) {
+        *this = other;
+    }
+
+    SmallVector(SmallVector &&other) noexcept : size_(0), capacity_(N) {
+        *this = std::move(other);
+    }
+
+    SmallVector &operator=(const SmallVector &other) {
+        if (this != &other) {
+            size_ = 0;
+            reserve(other.size_);
+            memcpy(data(), other.data(), other.size_ * sizeof(T));
+            size_ = other.size_;
+        }
+        return *this;
+    }
+
+    SmallVector &operator=(SmallVector &&other) noexcept {
+        if (this != &other) {
+            if (other.heap_) {
+                heap_ = std::move(other.heap_);
+                capacity_ = other.capacity_;
+            } else {
+                heap_.reset();
+                capacity_ = N;
+                memcpy(inline_, other.inline_, other.size_ * sizeof(T));
+            }
+            size_ = other.size_;
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+        return *this;
+    }
+
+    /*
+     * Make room for a number of values without moving them again.
+     * @param capacity: The number of values.
+     */
+    void reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        std::unique_ptr<T[]> heap(new T[capacity]);
+        memcpy(heap.get(), data(), size_ * sizeof(T));
+        heap_ = std::move(heap);
+        capacity_ = capacity;
+    }
+
+    void push_back(const T &value) {
+        if (size_ == capacity_) {
+            reserve(capacity_ * 2);
+        }
+        data()[size_++] = value;
+    }
+
+    void clear() {
+        size_ = 0;
+    }
+
+    T *data() {
+        return heap_ ? heap_.get() : inline_;
+    }
+
+    const T *data() const {
+        return heap_ ? heap_.get() : inline_;
+    }
+
+    T &operator[](size_t index) {
+        return data()[index];
+    }
+
+    const T &operator[](size_t index) const {
+        return data()[index];
+    }
+
+    T *begin() {
+        return data();
+    }
+
+    T *end() {
+        return data() + size_;
+    }
+
+    const T *begin() const {
+        return data();
+    }
+
+    const T *end() const {
+        return data() + size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A hierarchical timer wheel.
+ * Time advances in ticks of a fixed duration. The wheel has LEVEL_NUM
+ * levels of 64 slots, a slot of level L spans 64^L ticks: a timer is put
+ * in the lowest level whose range covers its deadline, and when the lower
+ * level wraps around, the timers of the next slot of the level above are
+ * spread over the level below (cascading). Scheduling and cancelling are
+ * O(1), and the timers due on the same tick are expired together.
+ * The timers are intrusive nodes living in the timed objects, which must
+ * not move while scheduled. Not thread-safe, every reactor owns its wheel.
+ */
+class TimerWheel {
+public:
+    struct Timer {
+        Timer *prev = nullptr;
+        Timer *next = nullptr;
+        uint64_t expire = 0;  // tick
+        uint64_t data = 0;
+
+        Timer() {}
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        bool active() const {
+            return prev != nullptr;
+        }
+    };
+
+    static constexpr int LEVEL_NUM = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOT_NUM = 1 << SLOT_BITS;
+
+private:
+    // Every slot is a circular list with a sentinel node.
+    Timer slots_[LEVEL_NUM][SLOT_NUM];
+    // The non-empty slots of every level, a bit per slot.
+    uint64_t occupied_[LEVEL_NUM];
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::milliseconds tick_;
+    // The last tick processed.
+    uint64_t current_;
+    size_t size_;
+
+    void link(Timer &timer);
+    void unlink(Timer &timer);
+    void cascade(int level);
+    uint64_t tick_of(std::chrono::steady_clock::time_point time) const;
+    uint64_t next_tick() const;
+
+public:
+    /*
+     * Constructor.
+     * @param tick: The duration of a tick, the precision of the deadlines.
+     */
+    explicit TimerWheel(std::chrono::milliseconds tick);
+    ~TimerWheel() {}
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    /*
+     * Schedule a timer, or reschedule it if it is already scheduled.
+     * The deadline is rounded up to the next tick.
+     * @param timer: The timer.
+     * @param timeout: The time from now to the deadline.
+     * @param data: The value reported when the timer expires.
+     */
+    void schedule(Timer &timer, std::chrono::milliseconds timeout, uint64_t data);
+
+    /*
+     * Cancel a timer, nothing happens if it is not scheduled.
+     * @param timer: The timer.
+     */
+    void cancel(Timer &timer);
+
+    /*
+     * Expire the timers whose deadline has passed.
+     * The expired timers are unscheduled before being reported, so they
+     * may be scheduled again right away.
+     * @param expired: The data of the expired timers are appended to it.
+     * @return The number of expired timers.
+     */
+    size_t advance(std::vector<uint64_t> &expired);
+
+    /*
+     * Get the time until the wheel has to advance, e.g. for epoll_wait.
+     * It may be earlier than the next deadline when the timers of a higher
+     * level have to cascade, it is never later.
+     * @return The milliseconds until then, -1 if no timer is scheduled.
+     */
+    int next_timeout() const;
+
+    size_t size() const {
+        return size_;
+    }
+};
+
+#endif
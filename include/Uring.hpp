@@ -0,0 +1,188 @@
+#ifndef __URING_HPP__
+#define __URING_HPP__
+
+#include "def.hpp"
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * An io_uring instance driven with the raw system calls.
+ * The operations are prepared in the shared submission ring without
+ * entering the kernel, and submitted in one batch together with the wait
+ * for the completions, so a round of the event loop takes one system call
+ * however many sockets it serves.
+ * The received bytes land in buffers provided to the kernel, which picks
+ * one per completion, so a multishot recv holds no buffer while its socket
+ * is idle. The buffers consumed are provided again in batches.
+ * Only used by the thread which created it.
+ */
+class Uring {
+private:
+    int ringfd_;
+    unsigned features_;
+    // The rings mapped from the kernel, the submission and the completion
+    // rings share one mapping if the kernel allows it.
+    void *sq_ring_;
+    size_t sq_ring_size_;
+    void *cq_ring_;
+    size_t cq_ring_size_;
+    io_uring_sqe *sqes_;
+    size_t sqes_size_;
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe *cqes_;
+    // The submissions prepared up to here, published on submit.
+    unsigned sq_local_tail_;
+    // The provided buffers, in one mapping.
+    char *buffers_;
+    size_t buffer_size_;
+    unsigned buffer_num_;
+    // The ids of the buffers consumed since the last submission.
+    std::vector<uint16_t> recycled_;
+
+    /*
+     * Get a cleared submission, the prepared ones are submitted if the
+     * ring is full.
+     * Throws std::runtime_error if they cannot be submitted.
+     */
+    io_uring_sqe *get_sqe();
+
+    /*
+     * Prepare the provision of consecutive buffers.
+     * @param id: The id of the first buffer.
+     * @param num: The number of buffers.
+     */
+    void prepare_provide(uint16_t id, unsigned num);
+
+    /*
+     * Prepare the provision of the buffers consumed, a run of consecutive
+     * ids takes one submission.
+     */
+    void provide_recycled();
+
+    void unmap();
+
+public:
+    // The user data of the operations of the instance itself, a caller
+    // ignores their completions.
+    static constexpr uint64_t INTERNAL_DATA = 0;
+
+    /*
+     * Constructor.
+     * Create an instance for the calling thread, with its provided buffers.
+     * Throws std::runtime_error if the kernel lacks a feature it needs.
+     * @param entries: The number of submissions, the completion ring is
+     *                 four times larger since a multishot operation posts
+     *                 many completions.
+     * @param buffer_num: The number of provided buffers, at most 65536.
+     * @param buffer_size: The size of a provided buffer.
+     */
+    Uring(unsigned entries, unsigned buffer_num, size_t buffer_size);
+    ~Uring();
+
+    Uring(const Uring &) = delete;
+    Uring &operator=(const Uring &) = delete;
+
+    /*
+     * Check once whether the kernel supports everything an instance needs:
+     * the multishot accept and recv into provided buffers, and waiting
+     * with a timeout while submitting.
+     */
+    static bool supported();
+
+    /*
+     * Prepare a multishot accept, every connection posts a completion
+     * with the non-blocking fd as result, the address is not returned.
+     * @param fd: The listening socket.
+     * @param data: The user data of the completions.
+     */
+    void prepare_accept(int fd, uint64_t data);
+
+    /*
+     * Prepare a multishot recv into the provided buffers, the completions
+     * carry the id of the buffer in their flags.
+     * @param fd: The socket.
+     * @param data: The user data of the completions.
+     */
+    void prepare_recv(int fd, uint64_t data);
+
+    /*
+     * Prepare a sendmsg. The message and its iovecs are read when the
+     * submission is, the bytes when it is executed.
+     * @param fd: The socket.
+     * @param msg: The message, valid until the next submission.
+     * @param flags: The flags of sendmsg.
+     * @param link: Whether the next submission only starts once this one
+     *              is complete, and is cancelled if this one fails.
+     * @param data: The user data of the completion.
+     */
+    void prepare_sendmsg(int fd, const msghdr *msg, int flags, bool link, uint64_t data);
+
+    /*
+     * Prepare a read.
+     * @param fd: The fd.
+     * @param buffer: The buffer, valid until the completion.
+     * @param size: The size of the buffer.
+     * @param data: The user data of the completion.
+     */
+    void prepare_read(int fd, void *buffer, size_t size, uint64_t data);
+
+    /*
+     * Prepare a one-shot poll.
+     * @param fd: The fd.
+     * @param events: The poll events, e.g. POLLOUT.
+     * @param data: The user data of the completion.
+     */
+    void prepare_poll(int fd, uint32_t events, uint64_t data);
+
+    /*
+     * Prepare the cancellation of the operations of a user data, or of
+     * every operation on a fd, or of every operation.
+     * The cancellation itself only posts a completion if it fails.
+     * @param target: The user data of the operations.
+     * @param fd: The fd of the operations.
+     * @param data: The user data of a failed cancellation.
+     */
+    void prepare_cancel(uint64_t target, uint64_t data);
+    void prepare_cancel_fd(int fd, uint64_t data);
+    void prepare_cancel_all(uint64_t data);
+
+    /*
+     * Submit the prepared operations without waiting.
+     * @return true if they are submitted, false otherwise.
+     */
+    bool submit();
+
+    /*
+     * Submit the prepared operations and wait for completions, with a
+     * single system call. The buffers consumed are provided again first.
+     * @param cqes: The buffer to store the completions, its size is the
+     *              maximum number of completions returned at once.
+     * @param timeout: The timeout in milliseconds, -1 to wait forever.
+     * @return The number of completions, or -1 on error (EINTR is retried).
+     */
+    int wait(std::vector<io_uring_cqe> &cqes, int timeout);
+
+    /*
+     * Get the bytes of a provided buffer picked for a recv.
+     * @param id: The id of the buffer, from the flags of the completion.
+     */
+    const char *buffer(uint16_t id) const;
+
+    /*
+     * Give a provided buffer back to the kernel once its bytes are consumed,
+     * with the next wait.
+     * @param id: The id of the buffer.
+     */
+    void recycle(uint16_t id);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __WORK_DEQUE_HPP__
+#define __WORK_DEQUE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * A bounded lock-free work-stealing deque (Chase-Lev).
+ * Its owner pushes and pops at the bottom, last in first out, so it keeps
+ * working on the tasks whose data is still in its cache. Any other thread
+ * steals at the top, the oldest tasks, and only contends with the owner
+ * for the last one. The capacity is a power of two and the deque never
+ * grows, a full deque refuses the push.
+ * T is copied in and out of atomics, e.g. a pointer.
+ */
+template <typename T>
+class WorkDeque {
+private:
+    std::unique_ptr<std::atomic<T>[]> slots_;
+    int64_t mask_;
+    // Advanced by the thieves, and by the owner taking the last task.
+    alignas(64) std::atomic<int64_t> top_;
+    // Written by the owner.
+    alignas(64) std::atomic<int64_t> bottom_;
+
+public:
+    /*
+     * Constructor.
+     * @param capacity: The maximum number of elements, rounded up to a power of two.
+     */
+    explicit WorkDeque(size_t capacity) : top_(0), bottom_(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_ = std::unique_ptr<std::atomic<T>[]>(new std::atomic<T>[size]);
+        mask_ = size - 1;
+    }
+    ~WorkDeque() {}
+
+    WorkDeque(const WorkDeque &) = delete;
+    WorkDeque &operator=(const WorkDeque &) = delete;
+
+    /*
+     * Push an element at the bottom, called by the owner only.
+     * @param value: The element to push.
+     * @return false if the deque is full, true otherwise.
+     */
+    bool push(T value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        if (bottom - top > mask_) {
+            return false;
+        }
+        slots_[bottom & mask_].store(value, std::memory_order_relaxed);
+        // Publish the element before the new bottom.
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /*
+     * Pop the newest element at the bottom, called by the owner only.
+     * @param value: The popped element.
+     * @return false if the deque is empty, or a thief took the last element.
+     */
+    bool pop(T &value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        // The thieves must see the reserved slot before the owner reads top.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = slots_[bottom & mask_].load(std::memory_order_relaxed);
+        if (top < bottom) {
+            return true;
+        }
+        // The last element, race the thieves for it.
+        bool won = top_.compare_exchange_strong(
+            top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed
+        );
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    /*
+     * Steal the oldest element at the top, called by any thread.
+     * @param value: The stolen element.
+     * @return false if the deque is empty, or another thread took the element.
+     */
+    bool steal(T &value) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+        value = slots_[top & mask_].load(std::memory_order_relaxed);
+        return top_.compare_exchange_strong(
+            top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed
+        );
+    }
+
+    /*
+     * Get the number of elements, a snapshot.
+     */
+    size_t size() const {
+        int64_t top = top_.load(std::memory_order_acquire);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        return bottom > top ? bottom - top : 0;
+    }
+};
+
+#endif
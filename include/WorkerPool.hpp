@@ -0,0 +1,114 @@
+#ifndef __WORKER_POOL_HPP__
+#define __WORKER_POOL_HPP__
+
+#include "def.hpp"
+#include "Metrics.hpp"
+#include "WorkDeque.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A unit of blocking or cpu-heavy work, e.g. loading a cold file.
+ * Allocated by the submitter, the pool only calls run, which is its last
+ * use of the task: the task deletes itself or hands itself over, e.g. as
+ * its own completion back to the submitter.
+ */
+class Task {
+public:
+    virtual ~Task() {}
+    virtual void run() = 0;
+};
+
+/*
+ * A work-stealing thread pool.
+ * Every worker has its own WorkDeque: the tasks a task submits go to the
+ * deque of its worker, and an idle worker steals the oldest tasks of the
+ * others, so a burst spreads over the pool without a shared lock. The
+ * tasks of the other threads (e.g. the reactors) go through a bounded
+ * injection queue, a full queue refuses them so that the submitter can
+ * run the task itself rather than pile up work. A worker takes its share
+ * of the injected tasks at once into its deque, so the lock of the queue
+ * is taken once per batch and the others steal the rest.
+ * The idle workers sleep on a condition variable and are woken by the
+ * submissions, and by a worker moving a batch to its deque.
+ * The tasks left are run before the destructor returns.
+ */
+class WorkerPool {
+private:
+    struct Worker {
+        WorkDeque<Task *> deque;
+        std::thread thread;
+        // Written by the worker.
+        Counter executed;
+        Counter stolen;
+
+        Worker() : deque(WORKER_DEQUE_SIZE) {}
+    };
+
+    std::vector<std::unique_ptr<Worker> > workers_;
+    // The injection queue, bounded by queue_size_.
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::deque<Task *> injected_;
+    size_t queue_size_;
+    bool running_;
+    // The tasks queued anywhere, and the workers asleep. A submitter only
+    // takes the lock to wake a worker if one sleeps.
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> sleeping_;
+    std::atomic<uint64_t> rejected_;
+
+    /*
+     * Run the tasks until the pool is destroyed and no task is left.
+     * @param index: The index of the worker.
+     */
+    void work(size_t index);
+
+    /*
+     * Find a task: pop the own deque, then the injection queue, then steal.
+     * @param index: The index of the worker.
+     * @return The task, or nullptr if none is queued.
+     */
+    Task *find_task(size_t index);
+
+    /*
+     * Wake up a sleeping worker, if any, after a task is queued.
+     */
+    void notify();
+
+public:
+    /*
+     * Constructor, start the workers.
+     * @param worker_num: The number of workers, at least 1.
+     * @param queue_size: The capacity of the injection queue.
+     */
+    WorkerPool(size_t worker_num, size_t queue_size);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /*
+     * Submit a task, called by any thread. A task submitted by a worker
+     * goes to its own deque, or is run at once if the deque and the
+     * injection queue are full.
+     * @param task: The task, taken over only if true is returned.
+     * @return false if the injection queue is full, true otherwise.
+     */
+    bool submit(Task *task);
+
+    // The statistics, snapshots read by any thread.
+    size_t size() const;
+    size_t queued() const;
+    uint64_t executed() const;
+    uint64_t stolen() const;
+    uint64_t rejected() const;
+};
+
+#endif
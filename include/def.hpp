@@ -1,13 +1,46 @@
 #ifndef __DEF_HPP__
 #define __DEF_HPP__
 
-#define MAX_BUFFER_SIZE 65536
-#define MAX_CLIENT_NUM 255
-#define MAX_EPOLL_EVENTS 1
-#define TIMEOUT 200
+#define BUFFER_SIZE 65536  // bytes, a pooled receive buffer
+#define BUFFER_BLOCK_SIZE (2 << 20)  // bytes, the buffers are mapped by blocks of a huge page
+#define MAX_REQUEST_SIZE (1 << 20)  // bytes, request line and headers
+#define MAX_HEADER_NUM 64
+#define INLINE_HEADER_NUM 16  // per message, the headers after them are indexed on the heap
+#define INLINE_FORM_FIELD_NUM 8  // per form or query string, the fields after them are indexed on the heap
+#define MAX_BODY_SIZE (1 << 20)  // bytes, the default limit of a request body per route
+#define MAX_CHUNK_LINE_SIZE 4096  // bytes, the extensions of a chunk or the trailer
+#define MAX_RANGE_NUM 16  // per request, more ranges are ignored
+#define MAX_CLIENT_NUM 262144  // per reactor
+#define LISTEN_BACKLOG 4096
+#define MAX_EPOLL_EVENTS 64
+#define MAX_URING_EVENTS 256  // completions dispatched per round
+#define URING_ENTRIES 1024  // submissions per reactor, the completion ring is four times larger
+#define URING_BUFFER_NUM 256  // provided receive buffers per reactor, a power of 2
+#define URING_BUFFER_SIZE 16384  // bytes, a provided receive buffer
+#define URING_SEND_IOV_NUM 32  // iovecs per sendmsg, a longer batch takes a chain of linked ones
+#define URING_SEND_SLOT_NUM 128  // sendmsg prepared per submission
+#define KEEPALIVE_MAX_REQUESTS 100
+#define KEEPALIVE_TIMEOUT 5000  // ms, idle between two requests
+#define HEADER_TIMEOUT 10000  // ms, to receive the headers of a request
+#define BODY_TIMEOUT 10000  // ms, between two reads of a request body
+#define WRITE_TIMEOUT 10000  // ms, between two writes of a stalled response
+#define LINGER_TIMEOUT 2000  // ms, to drain a refused request body before closing
+#define TIMER_TICK 10  // ms, the precision of the timeouts
+#define ASSET_CACHE_SIZE (64 << 20)  // bytes
+#define SENDFILE_MIN_SIZE (256 << 10)  // bytes, larger files are streamed instead of held in memory
+#define MAX_ASSET_ALIASES 8  // spellings kept per cached path, the others are resolved on every hit
+#define SENDFILE_CHUNK_SIZE (1 << 20)  // bytes
+#define COMPRESS_MIN_SIZE 1024  // bytes, smaller assets are not compressed
+#define COMPRESS_LEVEL 9  // zlib, the assets are compressed once
+#define WORKER_DEQUE_SIZE 1024  // tasks per worker, a full deque spills into the injection queue
+#define WORKER_QUEUE_SIZE 4096  // tasks submitted by the reactors, more are handled inline
+#define ACCESS_LOG_RING_SIZE 16384  // records per reactor
+#define ACCESS_LOG_BUFFER_SIZE 65536  // bytes, written at once
+#define ACCESS_LOG_INTERVAL 10  // ms, the writer sleeps when there is nothing to write
 
 #define SERVER_ADDR INADDR_ANY
 #define SERVER_PORT 2024
+#define SERVER_NAME "zjucn-webserver"  // the Server header
 #define USERNAME "username"
 #define PASSWORD "password"
 
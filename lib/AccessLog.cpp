@@ -0,0 +1,161 @@
+#include "AccessLog.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+AccessLog::AccessLog(
+    const std::string &path,
+    const std::vector<std::string> &route_names,
+    size_t producer_num,
+    size_t capacity
+) : route_names_(route_names), dropped_(0), running_(true) {
+    if (path == "-") {
+        fd_ = STDOUT_FILENO;
+        close_fd_ = false;
+    } else {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            std::string error_msg = "AccessLog Init failed: failed to open " + path + ". errno: " +
+                                    std::to_string(errno) + " " + strerror(errno);
+            throw std::runtime_error(error_msg);
+        }
+        close_fd_ = true;
+    }
+    for (size_t i = 0; i < producer_num; i++) {
+        rings_.push_back(std::make_unique<Ring<AccessRecord> >(capacity));
+    }
+    writer_ = std::thread(&AccessLog::write_loop, this);
+}
+
+AccessLog::~AccessLog() {
+    running_ = false;
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (close_fd_) {
+        close(fd_);
+    }
+}
+
+bool AccessLog::log(size_t producer, AccessRecord &record) {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    record.timestamp = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    if (!rings_[producer]->push(record)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+uint64_t AccessLog::dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+size_t AccessLog::depth() const {
+    size_t depth = 0;
+    for (auto &ring : rings_) {
+        depth += ring->size();
+    }
+    return depth;
+}
+
+void AccessLog::write_loop() {
+    std::string buffer;
+    buffer.reserve(ACCESS_LOG_BUFFER_SIZE);
+    uint64_t reported = 0;
+    while (true) {
+        // Read the flag first, so the records pushed before stopping are written.
+        bool running = running_;
+        size_t count = drain(buffer);
+
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported) {
+            buffer += "[ERR] Access log dropped " + std::to_string(dropped - reported) + " records.\n";
+            reported = dropped;
+        }
+        write_out(buffer);
+
+        if (!running) {
+            return;
+        }
+        if (count == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ACCESS_LOG_INTERVAL));
+        }
+    }
+}
+
+size_t AccessLog::drain(std::string &buffer) {
+    static const char *const months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+    // The date part only changes once per second.
+    time_t second = -1;
+    char date[32] = "";
+
+    size_t count = 0;
+    AccessRecord record;
+    for (auto &ring : rings_) {
+        while (ring->pop(record)) {
+            time_t now = static_cast<time_t>(record.timestamp / 1000000000);
+            if (now != second) {
+                tm t;
+                gmtime_r(&now, &t);
+                snprintf(
+                    date, sizeof(date), "%02d/%s/%04d:%02d:%02d:%02d",
+                    t.tm_mday, months[t.tm_mon], t.tm_year + 1900, t.tm_hour, t.tm_min, t.tm_sec
+                );
+                second = now;
+            }
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &record.addr, ip, sizeof(ip));
+            const char *method = "-";
+            if (record.method == static_cast<int8_t>(MethodTypes::GET)) {
+                method = "GET";
+            } else if (record.method == static_cast<int8_t>(MethodTypes::POST)) {
+                method = "POST";
+            }
+            const char *route = record.route < route_names_.size() ?
+                                route_names_[record.route].c_str() : "-";
+
+            // e.g. 127.0.0.1:51234 [16/Oct/2026:23:08:55.123 +0000] "GET /test.html" 200 325
+            char line[512];
+            int size = snprintf(
+                line, sizeof(line), "%s:%u [%s.%03d +0000] \"%s %s\" %d %llu\n",
+                ip, ntohs(record.port), date,
+                static_cast<int>(record.timestamp / 1000000 % 1000),
+                method, route, record.status,
+                static_cast<unsigned long long>(record.bytes)
+            );
+            buffer.append(line, std::min<size_t>(size, sizeof(line) - 1));
+            if (buffer.size() >= ACCESS_LOG_BUFFER_SIZE) {
+                write_out(buffer);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+void AccessLog::write_out(std::string &buffer) {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t size = write(fd_, buffer.data() + written, buffer.size() - written);
+        if (size == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The output is gone, the records are lost.
+            break;
+        }
+        written += size;
+    }
+    buffer.clear();
+}
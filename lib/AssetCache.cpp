@@ -0,0 +1,508 @@
+#include "AssetCache.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <zlib.h>
+
+// An open fd is charged as a page, so the streamed assets stay evictable.
+static const size_t FD_ASSET_COST = 4096;
+
+// The copies of a file taken before giving up on a file which keeps changing.
+static const int ASSET_COPY_ATTEMPTS = 3;
+
+// The changes of a watched directory which may change a cached file.
+static const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE |
+                                     IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+bool is_compressible(const std::string &content_type) {
+    static const char *const types[] = {
+        "application/javascript",
+        "application/json",
+        "application/wasm",
+        "application/xml",
+        "image/svg+xml"
+    };
+    if (content_type.compare(0, 5, "text/") == 0) {
+        return true;
+    }
+    for (const char *type : types) {
+        if (content_type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compress bytes into a gzip stream.
+static bool gzip(const char *data, size_t size, std::string &compressed) {
+    z_stream stream = {};
+    // 15 bits of window, plus 16 for the gzip wrapper.
+    if (deflateInit2(&stream, COMPRESS_LEVEL, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    compressed.resize(deflateBound(&stream, size));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = size;
+    stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+    stream.avail_out = compressed.size();
+    int status = deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+Asset::Asset(
+    std::string &&compressed,
+    const Asset &identity,
+    Encodings encoding
+) : fd_(-1), content_type_(identity.content_type_), last_modified_(identity.last_modified_),
+    mtime_(identity.mtime_), bytes_(std::move(compressed)) {
+    data_ = bytes_.data();
+    size_ = bytes_.size();
+    content_length_ = std::to_string(size_);
+    // A strong ETag differs between the encodings of the same file.
+    etag_ = identity.etag_.substr(0, identity.etag_.size() - 1) + "-" +
+            encoding_to_string(encoding) + "\"";
+}
+
+Asset::Asset(
+    const std::string &path,
+    const std::string &content_type,
+    size_t max_memory_size,
+    bool encode
+) : data_(nullptr), fd_(-1), size_(0), content_type_(content_type) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::string error_msg = "Asset Load failed: failed to open " + path + ". errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        throw std::runtime_error("Asset Load failed: " + path + " is not a regular file.");
+    }
+    if (static_cast<size_t>(st.st_size) <= max_memory_size) {
+        // Copy the file, and copy it again if it changed meanwhile, so the
+        // bytes held match the validators.
+        for (int attempt = 1; ; attempt++) {
+            bytes_.resize(st.st_size);
+            size_t copied = 0;
+            while (copied < bytes_.size()) {
+                ssize_t size = pread(fd, &bytes_[copied], bytes_.size() - copied, copied);
+                if (size < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (size <= 0) {
+                    break;
+                }
+                copied += size;
+            }
+            struct stat copied_st;
+            if (fstat(fd, &copied_st) < 0) {
+                close(fd);
+                std::string error_msg = "Asset Load failed: failed to read " + path + ". errno: " +
+                                        std::to_string(errno) + " " + strerror(errno);
+                throw std::runtime_error(error_msg);
+            }
+            if (
+                copied == bytes_.size() &&
+                copied_st.st_size == st.st_size &&
+                copied_st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+                copied_st.st_mtim.tv_nsec == st.st_mtim.tv_nsec
+            ) {
+                break;
+            }
+            if (attempt == ASSET_COPY_ATTEMPTS) {
+                close(fd);
+                throw std::runtime_error("Asset Load failed: " + path + " keeps changing.");
+            }
+            st = copied_st;
+        }
+        data_ = bytes_.data();
+    }
+    size_ = st.st_size;
+    content_length_ = std::to_string(size_);
+    mtime_ = st.st_mtime;
+    last_modified_ = http_date(mtime_);
+    char etag[64];
+    snprintf(
+        etag,
+        sizeof(etag),
+        "\"%llx-%llx-%llx\"",
+        static_cast<unsigned long long>(st.st_ino),
+        static_cast<unsigned long long>(st.st_size),
+        static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec
+    );
+    etag_ = etag;
+    if (data_ == nullptr) {
+        // Keep the file open, sendfile is given explicit offsets so the fd
+        // can be shared by concurrent responses.
+        fd_ = fd;
+    } else {
+        close(fd);
+    }
+    if (encode) {
+        load_encodings(path, max_memory_size);
+    }
+}
+
+void Asset::load_encodings(const std::string &path, size_t max_memory_size) {
+    // The sidecars are compressed ahead of time, e.g. by "gzip -k" or "brotli -k".
+    static const std::pair<Encodings, const char *> sidecars[] = {
+        {Encodings::BROTLI, ".br"},
+        {Encodings::GZIP, ".gz"}
+    };
+    for (auto &sidecar : sidecars) {
+        std::string sidecar_path = path + sidecar.second;
+        struct stat st;
+        if (stat(sidecar_path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        try {
+            encoded_[static_cast<int>(sidecar.first)] = std::unique_ptr<const Asset>(
+                new Asset(sidecar_path, content_type_, max_memory_size, false)
+            );
+        } catch (std::exception &e) {
+            // Serve the other variants.
+        }
+    }
+
+    // Compress once, only if it is worth it.
+    const int gzip_index = static_cast<int>(Encodings::GZIP);
+    if (
+        encoded_[gzip_index] == nullptr && in_memory() &&
+        size_ >= COMPRESS_MIN_SIZE && is_compressible(content_type_)
+    ) {
+        std::string compressed;
+        if (gzip(data_, size_, compressed) && compressed.size() < size_) {
+            encoded_[gzip_index] = std::unique_ptr<const Asset>(
+                new Asset(std::move(compressed), *this, Encodings::GZIP)
+            );
+        }
+    }
+}
+
+Asset::~Asset() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool Asset::in_memory() const {
+    return fd_ < 0;
+}
+
+const char *Asset::data() const {
+    return data_;
+}
+
+int Asset::fd() const {
+    return fd_;
+}
+
+size_t Asset::size() const {
+    return size_;
+}
+
+size_t Asset::cost() const {
+    size_t cost = in_memory() ? size_ : FD_ASSET_COST;
+    for (auto &encoded : encoded_) {
+        if (encoded != nullptr) {
+            cost += encoded->cost();
+        }
+    }
+    return cost;
+}
+
+const std::string &Asset::get_content_type() const {
+    return content_type_;
+}
+
+const std::string &Asset::get_content_length() const {
+    return content_length_;
+}
+
+const std::string &Asset::get_etag() const {
+    return etag_;
+}
+
+const std::string &Asset::get_last_modified() const {
+    return last_modified_;
+}
+
+time_t Asset::get_mtime() const {
+    return mtime_;
+}
+
+const Asset *Asset::encoded(Encodings encoding) const {
+    if (encoding == Encodings::IDENTITY) {
+        return this;
+    }
+    return encoded_[static_cast<int>(encoding)].get();
+}
+
+bool Asset::has_encodings() const {
+    for (auto &encoded : encoded_) {
+        if (encoded != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+AssetCache::AssetCache(
+    size_t budget,
+    size_t max_memory_size
+) : budget_(budget), max_memory_size_(max_memory_size), used_(0), generation_(0) {
+    hand_ = clock_.end();
+
+    // Start the watcher, woken up by the eventfd to stop.
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        std::string error_msg = "AssetCache Init failed: failed to create an inotify instance. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+    eventfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventfd_ < 0) {
+        close(inotify_fd_);
+        std::string error_msg = "AssetCache Init failed: failed to create an eventfd. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+    watcher_ = std::thread(&AssetCache::watch, this);
+}
+
+AssetCache::~AssetCache() {
+    uint64_t value = 1;
+    if (write(eventfd_, &value, sizeof(value)) >= 0) {
+        watcher_.join();
+    } else {
+        watcher_.detach();
+    }
+    close(eventfd_);
+    close(inotify_fd_);
+}
+
+std::shared_ptr<const Asset> AssetCache::get(const std::string &path, const std::string &content_type) {
+    // Fast path, the asset is cached under this spelling.
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = find(path);
+        if (it != entries_.end()) {
+            it->second.referenced.store(true, std::memory_order_relaxed);
+            return it->second.asset;
+        }
+    }
+
+    // Resolve the path, so the spellings of a file share its asset.
+    char *resolved = realpath(path.c_str(), nullptr);
+    if (resolved == nullptr) {
+        return nullptr;
+    }
+    std::string key = resolved;
+    free(resolved);
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            it->second.referenced.store(true, std::memory_order_relaxed);
+            add_alias(path, it);
+            return it->second.asset;
+        }
+    }
+
+    // Watch the directory before loading, so a change during the load is seen.
+    size_t slash = key.rfind('/');
+    std::string directory = slash == 0 ? "/" : key.substr(0, slash);
+    int wd = inotify_add_watch(inotify_fd_, directory.c_str(), WATCH_EVENTS);
+    uint64_t generation = generation_.load(std::memory_order_acquire);
+
+    // Load the asset without holding the lock.
+    std::shared_ptr<const Asset> asset;
+    try {
+        asset = std::make_shared<const Asset>(key, content_type, max_memory_size_);
+    } catch (std::exception &e) {
+        return nullptr;
+    }
+    // An asset which cannot be watched would go stale, it is not kept.
+    if (asset->cost() > budget_ || wd < 0) {
+        return asset;
+    }
+
+    // Insert the asset, unless another thread did it in the meantime,
+    // or a file changed while it was loaded.
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (generation_.load(std::memory_order_acquire) != generation) {
+        return asset;
+    }
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        add_alias(path, it);
+        return it->second.asset;
+    }
+    make_room(asset->cost());
+    it = entries_.try_emplace(key).first;
+    Entry &entry = it->second;
+    entry.asset = asset;
+    entry.clock_it = clock_.insert(hand_, key);
+    entry.referenced.store(true, std::memory_order_relaxed);
+    entry.wd = wd;
+    watches_[wd].insert(key);
+    add_alias(path, it);
+    used_ += asset->cost();
+    return asset;
+}
+
+std::unordered_map<std::string, AssetCache::Entry>::iterator AssetCache::find(const std::string &path) {
+    auto alias = aliases_.find(path);
+    if (alias != aliases_.end()) {
+        return entries_.find(alias->second);
+    }
+    // The canonical path is its own spelling.
+    return entries_.find(path);
+}
+
+void AssetCache::add_alias(const std::string &path, std::unordered_map<std::string, Entry>::iterator it) {
+    // The other spellings, e.g. with repeated slashes, are resolved on every hit.
+    if (path == it->first || it->second.aliases.size() >= MAX_ASSET_ALIASES) {
+        return;
+    }
+    if (aliases_.emplace(path, it->first).second) {
+        it->second.aliases.push_back(path);
+    }
+}
+
+void AssetCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+    Entry &entry = it->second;
+    used_ -= entry.asset->cost();
+    if (hand_ == entry.clock_it) {
+        hand_ = clock_.erase(hand_);
+    } else {
+        clock_.erase(entry.clock_it);
+    }
+    for (auto &alias : entry.aliases) {
+        aliases_.erase(alias);
+    }
+    auto watch = watches_.find(entry.wd);
+    if (watch != watches_.end()) {
+        watch->second.erase(it->first);
+    }
+    // The responses in flight keep their asset alive.
+    entries_.erase(it);
+}
+
+void AssetCache::remove(const std::string &path) {
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        erase(it);
+    }
+}
+
+void AssetCache::clear() {
+    entries_.clear();
+    aliases_.clear();
+    clock_.clear();
+    hand_ = clock_.end();
+    used_ = 0;
+    for (auto &watch : watches_) {
+        watch.second.clear();
+    }
+}
+
+void AssetCache::watch() {
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {eventfd_, POLLIN, 0}};
+    alignas(inotify_event) char buffer[4096];
+    std::vector<std::string> changed;
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        ssize_t size = read(inotify_fd_, buffer, sizeof(buffer));
+        if (size <= 0) {
+            continue;
+        }
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (char *p = buffer; p < buffer + size; ) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Some events are lost, drop everything.
+                clear();
+                continue;
+            }
+            auto it = watches_.find(event->wd);
+            if (it == watches_.end()) {
+                continue;
+            }
+            changed.clear();
+            if (event->mask & IN_IGNORED) {
+                // The directory is gone, and its files with it.
+                changed.assign(it->second.begin(), it->second.end());
+                watches_.erase(it);
+            } else if (event->len > 0) {
+                // The file itself, or the file of a sidecar, which changes
+                // the variants of its file.
+                std::string_view name = event->name;
+                std::string_view base = name;
+                for (const char *suffix : {".gz", ".br"}) {
+                    if (name.size() > 3 && name.substr(name.size() - 3) == suffix) {
+                        base = name.substr(0, name.size() - 3);
+                    }
+                }
+                for (auto &key : it->second) {
+                    std::string_view key_name = std::string_view(key).substr(key.rfind('/') + 1);
+                    if (key_name == name || key_name == base) {
+                        changed.push_back(key);
+                    }
+                }
+            }
+            for (auto &key : changed) {
+                remove(key);
+            }
+        }
+    }
+}
+
+void AssetCache::make_room(size_t size) {
+    while (used_ + size > budget_ && !clock_.empty()) {
+        if (hand_ == clock_.end()) {
+            hand_ = clock_.begin();
+        }
+        auto it = entries_.find(*hand_);
+        if (it->second.referenced.exchange(false, std::memory_order_relaxed)) {
+            // Give the asset a second chance.
+            hand_++;
+            continue;
+        }
+        erase(it);
+    }
+}
+
+bool AssetCache::contains(const std::string &path) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return find(path) != entries_.end();
+}
+
+size_t AssetCache::used() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return used_;
+}
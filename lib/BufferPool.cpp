@@ -0,0 +1,84 @@
+#include "BufferPool.hpp"
+#include <sys/mman.h>
+
+BufferPool::BufferPool(size_t buffer_size, size_t block_size, bool huge_pages) :
+    buffer_size_(buffer_size),
+    block_size_(block_size < buffer_size ? buffer_size : block_size),
+    huge_pages_(huge_pages) {}
+
+BufferPool::~BufferPool() {
+    for (Block &block : blocks_) {
+        munmap(block.data, block.size);
+    }
+}
+
+bool BufferPool::grow() {
+    void *data = MAP_FAILED;
+    bool huge = false;
+    if (huge_pages_) {
+        // The reserved huge pages may be used up, fall back to the
+        // transparent ones which the kernel gives when it can.
+        data = mmap(nullptr, block_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = data != MAP_FAILED;
+    }
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, block_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        if (huge_pages_) {
+            madvise(data, block_size_, MADV_HUGEPAGE);
+        }
+    }
+    blocks_.push_back({static_cast<char *>(data), block_size_});
+    mapped_.add(block_size_);
+    if (huge) {
+        huge_mapped_.add(block_size_);
+    }
+
+    // Push in reverse, so the buffers are borrowed in address order.
+    size_t buffer_num = block_size_ / buffer_size_;
+    for (size_t i = buffer_num; i > 0; i--) {
+        free_.push_back(static_cast<char *>(data) + (i - 1) * buffer_size_);
+    }
+    return true;
+}
+
+char *BufferPool::acquire() {
+    if (free_.empty() && !grow()) {
+        return nullptr;
+    }
+    char *buffer = free_.back();
+    free_.pop_back();
+    borrowed_.add();
+    return buffer;
+}
+
+void BufferPool::release(char *buffer) {
+    free_.push_back(buffer);
+    borrowed_.set(borrowed_.get() - 1);
+}
+
+void BufferPool::track_large(size_t old_size, size_t size) {
+    large_.set(large_.get() - old_size + size);
+}
+
+size_t BufferPool::buffer_size() const {
+    return buffer_size_;
+}
+
+uint64_t BufferPool::borrowed() const {
+    return borrowed_.get();
+}
+
+uint64_t BufferPool::mapped() const {
+    return mapped_.get();
+}
+
+uint64_t BufferPool::huge_mapped() const {
+    return huge_mapped_.get();
+}
+
+uint64_t BufferPool::large() const {
+    return large_.get();
+}
@@ -0,0 +1,45 @@
+#include "Epoll.hpp"
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+Epoll::Epoll() {
+    epollfd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd_ < 0) {
+        std::string error_msg = "Epoll Init failed: failed to create an epoll instance. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+}
+
+Epoll::~Epoll() {
+    close(epollfd_);
+}
+
+bool Epoll::add(int fd, uint32_t events, uint64_t data) {
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = data;
+    return epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool Epoll::modify(int fd, uint32_t events, uint64_t data) {
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = data;
+    return epoll_ctl(epollfd_, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+bool Epoll::remove(int fd) {
+    return epoll_ctl(epollfd_, EPOLL_CTL_DEL, fd, nullptr) == 0;
+}
+
+int Epoll::wait(std::vector<epoll_event> &events, int timeout) {
+    int nfds;
+    do {
+        nfds = epoll_wait(epollfd_, events.data(), events.size(), timeout);
+    } while (nfds == -1 && errno == EINTR);
+    return nfds;
+}
@@ -0,0 +1,97 @@
+#include "Form.hpp"
+
+// The value of a hex digit, -1 if it is not one.
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+void percent_decode(std::string_view encoded, bool plus_as_space, std::string &decoded) {
+    for (size_t i = 0; i < encoded.size(); i++) {
+        char c = encoded[i];
+        if (c == '%' && i + 2 < encoded.size()) {
+            int high = hex_value(encoded[i + 1]);
+            int low = hex_value(encoded[i + 2]);
+            if (high >= 0 && low >= 0) {
+                decoded += static_cast<char>(high << 4 | low);
+                i += 2;
+                continue;
+            }
+        }
+        decoded += plus_as_space && c == '+' ? ' ' : c;
+    }
+}
+
+Form::Form(std::string_view source, bool plus_as_space) :
+    source_(source), plus_as_space_(plus_as_space), parsed_(false) {}
+
+std::string_view Form::decode(std::string_view encoded) {
+    if (encoded.find_first_of(plus_as_space_ ? "%+" : "%") == std::string_view::npos) {
+        return encoded;
+    }
+    // The decoded bytes are never more than the encoded ones, so the string
+    // reserved for the whole source never moves and the views stay valid.
+    if (decoded_.capacity() < source_.size()) {
+        decoded_.reserve(source_.size());
+    }
+    size_t begin = decoded_.size();
+    percent_decode(encoded, plus_as_space_, decoded_);
+    return std::string_view(decoded_.data() + begin, decoded_.size() - begin);
+}
+
+void Form::parse() {
+    parsed_ = true;
+    std::string_view rest = source_;
+    while (!rest.empty()) {
+        size_t end = rest.find('&');
+        std::string_view pair = rest.substr(0, end);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        if (pair.empty()) {
+            continue;
+        }
+        size_t equal = pair.find('=');
+        Field field;
+        field.name = decode(pair.substr(0, equal));
+        field.value = equal == std::string_view::npos ? std::string_view() : decode(pair.substr(equal + 1));
+        fields_.push_back(field);
+    }
+}
+
+std::optional<std::string_view> Form::get(std::string_view name) {
+    if (!parsed_) {
+        parse();
+    }
+    for (const Field &field : fields_) {
+        if (field.name == name) {
+            return field.value;
+        }
+    }
+    return std::nullopt;
+}
+
+size_t Form::size() {
+    if (!parsed_) {
+        parse();
+    }
+    return fields_.size();
+}
+
+std::string_view Form::name(size_t index) {
+    if (!parsed_) {
+        parse();
+    }
+    return fields_[index].name;
+}
+
+std::string_view Form::value(size_t index) {
+    if (!parsed_) {
+        parse();
+    }
+    return fields_[index].value;
+}
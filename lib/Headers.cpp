@@ -0,0 +1,184 @@
+#include "Headers.hpp"
+#include <cstring>
+#include <strings.h>
+
+// Indexed by HeaderNames.
+static const std::string_view header_names[HEADER_NAME_NUM] = {
+    "",
+    "Accept-Encoding",
+    "Accept-Ranges",
+    "Allow",
+    "Cache-Control",
+    "Connection",
+    "Content-Encoding",
+    "Content-Length",
+    "Content-Range",
+    "Content-Type",
+    "Date",
+    "ETag",
+    "Expect",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "If-Range",
+    "Last-Modified",
+    "Range",
+    "Server",
+    "Transfer-Encoding",
+    "Vary"
+};
+
+// Compare two names case-insensitively.
+static inline bool same_name(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+HeaderNames intern_header(std::string_view name) {
+    // The known names are told apart by their length and first char,
+    // so at most one or two of them are compared.
+    if (name.size() < 4 || name.size() > 17) {
+        return HeaderNames::OTHER;
+    }
+    char first = name[0] | 0x20;
+    for (int i = 1; i < HEADER_NAME_NUM; i++) {
+        std::string_view known = header_names[i];
+        if (known.size() == name.size() && (known[0] | 0x20) == first && same_name(known, name)) {
+            return static_cast<HeaderNames>(i);
+        }
+    }
+    return HeaderNames::OTHER;
+}
+
+std::string_view header_name_to_string(HeaderNames name) {
+    return header_names[static_cast<int>(name)];
+}
+
+Headers::Headers() {
+    memset(known_, 0, sizeof(known_));
+}
+
+Headers::Headers(std::initializer_list<std::pair<std::string_view, std::string_view> > headers) : Headers() {
+    for (auto &header : headers) {
+        add(header.first, header.second);
+    }
+}
+
+void Headers::reserve(size_t num, size_t size) {
+    entries_.reserve(num);
+    // ": " and "\r\n" per line.
+    lines_.reserve(size + num * 4);
+}
+
+void Headers::add(HeaderNames name, std::string_view spelling, std::string_view value) {
+    if (name != HeaderNames::OTHER) {
+        spelling = header_names[static_cast<int>(name)];
+        uint16_t &known = known_[static_cast<int>(name)];
+        if (known == 0) {
+            known = entries_.size() + 1;
+        }
+    }
+    Entry entry;
+    entry.offset = lines_.size();
+    entry.value_length = value.size();
+    entry.name_length = spelling.size();
+    entry.name = name;
+    entries_.push_back(entry);
+    lines_.append(spelling.data(), spelling.size());
+    lines_.append(": ", 2);
+    lines_.append(value.data(), value.size());
+    lines_.append("\r\n", 2);
+}
+
+void Headers::add(std::string_view name, std::string_view value) {
+    add(intern_header(name), name, value);
+}
+
+size_t Headers::find(HeaderNames name, std::string_view spelling) const {
+    if (name != HeaderNames::OTHER) {
+        uint16_t known = known_[static_cast<int>(name)];
+        return known != 0 ? known - 1 : entries_.size();
+    }
+    for (size_t i = 0; i < entries_.size(); i++) {
+        if (entries_[i].name == HeaderNames::OTHER && same_name(this->name(i), spelling)) {
+            return i;
+        }
+    }
+    return entries_.size();
+}
+
+void Headers::replace(size_t index, std::string_view value) {
+    Entry &entry = entries_[index];
+    lines_.replace(entry.offset + entry.name_length + 2, entry.value_length, value.data(), value.size());
+    uint32_t old_length = entry.value_length;
+    entry.value_length = value.size();
+    for (size_t i = index + 1; i < entries_.size(); i++) {
+        entries_[i].offset = entries_[i].offset - old_length + value.size();
+    }
+}
+
+void Headers::set(HeaderNames name, std::string_view value) {
+    size_t index = find(name, header_names[static_cast<int>(name)]);
+    if (index < entries_.size()) {
+        replace(index, value);
+    } else {
+        add(name, header_names[static_cast<int>(name)], value);
+    }
+}
+
+void Headers::set(std::string_view name, std::string_view value) {
+    HeaderNames known = intern_header(name);
+    size_t index = find(known, name);
+    if (index < entries_.size()) {
+        replace(index, value);
+    } else {
+        add(known, name, value);
+    }
+}
+
+std::optional<std::string_view> Headers::get(HeaderNames name) const {
+    size_t index = find(name, header_names[static_cast<int>(name)]);
+    if (index == entries_.size()) {
+        return std::nullopt;
+    }
+    return value(index);
+}
+
+std::optional<std::string_view> Headers::get(std::string_view name) const {
+    size_t index = find(intern_header(name), name);
+    if (index == entries_.size()) {
+        return std::nullopt;
+    }
+    return value(index);
+}
+
+void Headers::clear() {
+    lines_.clear();
+    entries_.clear();
+    memset(known_, 0, sizeof(known_));
+}
+
+size_t Headers::size() const {
+    return entries_.size();
+}
+
+bool Headers::empty() const {
+    return entries_.empty();
+}
+
+HeaderNames Headers::name_id(size_t index) const {
+    return entries_[index].name;
+}
+
+std::string_view Headers::name(size_t index) const {
+    const Entry &entry = entries_[index];
+    return std::string_view(lines_.data() + entry.offset, entry.name_length);
+}
+
+std::string_view Headers::value(size_t index) const {
+    const Entry &entry = entries_[index];
+    return std::string_view(lines_.data() + entry.offset + entry.name_length + 2, entry.value_length);
+}
+
+std::string_view Headers::lines() const {
+    return lines_;
+}
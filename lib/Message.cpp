@@ -1,21 +1,279 @@
 #include "Message.hpp"
 #include <stdexcept>
+#include <strings.h>
+#include <atomic>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
 
-std::string status_code_to_string(const StatusCodes& status_code) {
-    switch (status_code) {
-        case StatusCodes::OK:
-            return "200 OK";
-        case StatusCodes::BAD_REQUEST:
-            return "400 Bad Request";
-        case StatusCodes::FORBIDDEN:
-            return "403 Forbidden";
-        case StatusCodes::NOT_FOUND:
-            return "404 Not Found";
-        case StatusCodes::INTERNAL_SERVER_ERROR:
-            return "500 Internal Server Error";
-        default:
-            throw std::invalid_argument("Invalid status code");
+// The status codes and their reason phrases, the only list of them: the
+// strings and the status lines of the codes are built from it.
+static const struct {
+    StatusCodes code;
+    const char* reason;
+} statuses[] = {
+    {StatusCodes::CONTINUE, "Continue"},
+    {StatusCodes::OK, "OK"},
+    {StatusCodes::PARTIAL_CONTENT, "Partial Content"},
+    {StatusCodes::NOT_MODIFIED, "Not Modified"},
+    {StatusCodes::BAD_REQUEST, "Bad Request"},
+    {StatusCodes::FORBIDDEN, "Forbidden"},
+    {StatusCodes::NOT_FOUND, "Not Found"},
+    {StatusCodes::METHOD_NOT_ALLOWED, "Method Not Allowed"},
+    {StatusCodes::CONTENT_TOO_LARGE, "Content Too Large"},
+    {StatusCodes::UNSUPPORTED_MEDIA_TYPE, "Unsupported Media Type"},
+    {StatusCodes::RANGE_NOT_SATISFIABLE, "Range Not Satisfiable"},
+    {StatusCodes::EXPECTATION_FAILED, "Expectation Failed"},
+    {StatusCodes::INTERNAL_SERVER_ERROR, "Internal Server Error"}
+};
+
+// The strings of a status code, built once.
+struct StatusTexts {
+    std::string text;       // e.g. "200 OK"
+    std::string lines[2];   // e.g. "HTTP/1.0 200 OK\r\n", "HTTP/1.1 200 OK\r\n"
+};
+
+// Get the strings of a status code, looked up by the code itself.
+static const StatusTexts& status_texts(const StatusCodes& status_code) {
+    static const int CODE_NUM = 600;
+    static const struct Table {
+        std::vector<StatusTexts> texts;
+        // The index in texts plus one, by code, 0 for an unknown code.
+        uint8_t indexes[CODE_NUM] = {};
+
+        Table() {
+            for (auto& status : statuses) {
+                std::string text = std::to_string(static_cast<int>(status.code)) + " " + status.reason;
+                texts.push_back({text, {"HTTP/1.0 " + text + "\r\n", "HTTP/1.1 " + text + "\r\n"}});
+                indexes[static_cast<int>(status.code)] = texts.size();
+            }
+        }
+    } table;
+    int code = static_cast<int>(status_code);
+    if (code < 0 || code >= CODE_NUM || table.indexes[code] == 0) {
+        throw std::invalid_argument("Invalid status code");
+    }
+    return table.texts[table.indexes[code] - 1];
+}
+
+const std::string& status_code_to_string(const StatusCodes& status_code) {
+    return status_texts(status_code).text;
+}
+
+std::string_view status_line(const StatusCodes& status_code, const std::string& version) {
+    return status_texts(status_code).lines[version == "HTTP/1.0" ? 0 : 1];
+}
+
+const std::string& encoding_to_string(const Encodings& encoding) {
+    static const std::string strings[ENCODING_NUM] = {"identity", "gzip", "br"};
+    return strings[static_cast<int>(encoding)];
+}
+
+unsigned accept_encodings(std::string_view accept_encoding) {
+    unsigned accepted = 0;
+    unsigned listed = 0;
+    bool star = false;
+    bool star_accepted = false;
+    // The value is a comma separated list of codings with optional weights,
+    // e.g. "gzip, br;q=0.8, *;q=0".
+    size_t begin = 0;
+    while (begin < accept_encoding.size()) {
+        size_t end = accept_encoding.find(',', begin);
+        if (end == std::string_view::npos) {
+            end = accept_encoding.size();
+        }
+        std::string_view item = accept_encoding.substr(begin, end - begin);
+        begin = end + 1;
+
+        // Split the coding and the weight, only q=0 matters.
+        size_t semicolon = item.find(';');
+        std::string_view coding = item.substr(0, semicolon);
+        size_t first = coding.find_first_not_of(" \t");
+        size_t last = coding.find_last_not_of(" \t");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+        coding = coding.substr(first, last - first + 1);
+        bool refused = false;
+        if (semicolon != std::string_view::npos) {
+            size_t q = item.find_first_of("qQ", semicolon);
+            size_t equal = q == std::string_view::npos ? q : item.find('=', q);
+            if (equal != std::string_view::npos) {
+                // strtod needs a terminated string, a weight is a few chars.
+                char weight[16] = {};
+                item.copy(weight, sizeof(weight) - 1, equal + 1);
+                refused = strtod(weight, nullptr) <= 0;
+            }
+        }
+
+        if (coding == "*") {
+            star = true;
+            star_accepted = !refused;
+            continue;
+        }
+        for (int i = 0; i < ENCODING_NUM; i++) {
+            const std::string& name = encoding_to_string(static_cast<Encodings>(i));
+            if (
+                (coding.size() == name.size() && strncasecmp(coding.data(), name.data(), name.size()) == 0) ||
+                (i == static_cast<int>(Encodings::GZIP) && coding.size() == 6 && strncasecmp(coding.data(), "x-gzip", 6) == 0)
+            ) {
+                listed |= 1u << i;
+                if (!refused) {
+                    accepted |= 1u << i;
+                }
+            }
+        }
+    }
+
+    // The codings not listed follow "*", identity is acceptable by default.
+    unsigned all = (1u << ENCODING_NUM) - 1;
+    if (star && star_accepted) {
+        accepted |= all & ~listed;
+    }
+    unsigned identity = 1u << static_cast<int>(Encodings::IDENTITY);
+    if (!(listed & identity) && !(star && !star_accepted)) {
+        accepted |= identity;
+    }
+    return accepted;
+}
+
+std::string http_date(time_t time) {
+    static const char *const days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char *const months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+    tm t;
+    gmtime_r(&time, &t);
+    char buffer[64];
+    snprintf(
+        buffer,
+        sizeof(buffer),
+        "%s, %02d %s %04d %02d:%02d:%02d GMT",
+        days[t.tm_wday], t.tm_mday, months[t.tm_mon], t.tm_year + 1900,
+        t.tm_hour, t.tm_min, t.tm_sec
+    );
+    return buffer;
+}
+
+bool parse_http_date(std::string_view date, time_t& time) {
+    // strptime needs a terminated string, an IMF-fixdate is 29 chars.
+    char buffer[64];
+    if (date.size() >= sizeof(buffer)) {
+        return false;
+    }
+    date.copy(buffer, date.size());
+    buffer[date.size()] = '\0';
+    tm t = {};
+    const char* end = strptime(buffer, "%a, %d %b %Y %H:%M:%S GMT", &t);
+    if (end == nullptr || *end != '\0') {
+        return false;
+    }
+    time = timegm(&t);
+    return time != -1;
+}
+
+// Parse the decimal digits of a range position, without a sign.
+static bool parse_position(std::string_view range, size_t begin, size_t end, size_t& position) {
+    if (begin == end) {
+        return false;
+    }
+    position = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (range[i] < '0' || range[i] > '9') {
+            return false;
+        }
+        size_t digit = range[i] - '0';
+        if (position > (SIZE_MAX - digit) / 10) {
+            // Larger than any body, the same as the largest position.
+            position = SIZE_MAX;
+        } else {
+            position = position * 10 + digit;
+        }
+    }
+    return true;
+}
+
+bool parse_range(std::string_view range, size_t size, std::vector<ByteRange>& ranges) {
+    static const char unit[] = "bytes=";
+    if (range.size() < sizeof(unit) - 1 || strncasecmp(range.data(), unit, sizeof(unit) - 1) != 0) {
+        return false;
+    }
+    // The value is a comma separated list of "first-last", "first-" or "-suffix".
+    size_t count = 0;
+    size_t begin = sizeof(unit) - 1;
+    while (begin <= range.size()) {
+        size_t end = range.find(',', begin);
+        if (end == std::string_view::npos) {
+            end = range.size();
+        }
+        size_t first = range.find_first_not_of(" \t", begin);
+        size_t last = range.find_last_not_of(" \t", end - 1);
+        begin = end + 1;
+        if (first >= end || last < first || last == std::string_view::npos) {
+            // Empty elements are allowed in a list.
+            continue;
+        }
+        last++;
+        size_t dash = range.find('-', first);
+        if (dash >= last || ++count > MAX_RANGE_NUM) {
+            return false;
+        }
+
+        size_t offset;
+        size_t stop;
+        if (dash == first) {
+            // The last bytes, all of them if the suffix is longer.
+            size_t suffix;
+            if (!parse_position(range, dash + 1, last, suffix)) {
+                return false;
+            }
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            offset = size - std::min(suffix, size);
+            stop = size;
+        } else {
+            if (!parse_position(range, first, dash, offset)) {
+                return false;
+            }
+            stop = size;
+            if (dash + 1 < last) {
+                size_t position;
+                if (!parse_position(range, dash + 1, last, position) || position < offset) {
+                    return false;
+                }
+                stop = std::min(position, size - 1) + 1;
+            }
+            if (offset >= size) {
+                continue;
+            }
+        }
+        ranges.push_back({offset, stop - offset});
+    }
+    return count > 0;
+}
+
+// Format the header lines for a second.
+static std::shared_ptr<const std::string> make_date_header(time_t now) {
+    return std::make_shared<const std::string>(
+        "Date: " + http_date(now) + "\r\nServer: " SERVER_NAME "\r\n"
+    );
+}
+
+std::shared_ptr<const std::string> date_header() {
+    static std::atomic<time_t> current(time(nullptr));
+    static std::shared_ptr<const std::string> header = make_date_header(current);
+
+    // The first thread seeing a new second regenerates the lines,
+    // the others keep sending the previous ones until it is done.
+    time_t now = time(nullptr);
+    time_t last = current.load(std::memory_order_relaxed);
+    if (now != last && current.compare_exchange_strong(last, now)) {
+        std::atomic_store(&header, make_date_header(now));
     }
+    return std::atomic_load(&header);
 }
 
 std::string method_type_to_string(const MethodTypes& method_type) {
@@ -30,124 +288,244 @@ std::string method_type_to_string(const MethodTypes& method_type) {
 }
 
 Message::Message(
-    const std::string& version,
-    const std::string& body,
-    const std::unordered_map<std::string, std::string>& headers
-) : version_(version), body_(body), headers_(headers) {}
+    std::string version,
+    std::string body,
+    Headers headers
+) : version_(std::move(version)), body_(std::move(body)), headers_(std::move(headers)) {}
 
-Message::Message(const Message& other) {
-    this->version_ = other.version_;
-    this->body_ = other.body_;
-    this->headers_ = other.headers_;
-}
-
-Message::~Message() {}
-
-std::string Message::get_version() const {
+const std::string& Message::get_version() const {
     return this->version_;
 }
 
-std::string Message::get_body() const {
+const std::string& Message::get_body() const {
     return this->body_;
 }
 
-std::unordered_map<std::string, std::string> Message::get_headers() const {
+void Message::append_body(std::string_view chunk) {
+    this->body_.append(chunk.data(), chunk.size());
+}
+
+const Headers& Message::get_headers() const {
     return this->headers_;
 }
 
-Message& Message::operator=(const Message& other) {
-    this->version_ = other.version_;
-    this->body_ = other.body_;
-    this->headers_ = other.headers_;
-    return *this;
+std::optional<std::string_view> Message::get_header(HeaderNames name) const {
+    return this->headers_.get(name);
+}
+
+std::optional<std::string_view> Message::get_header(std::string_view name) const {
+    return this->headers_.get(name);
 }
 
 Request::Request() : Message("", "", {}), method_type_(MethodTypes::UNKNOWN), url_("") {}
 
 Request::Request(
-    const MethodTypes& method_type,
-    const std::string& url,
-    const std::string& version,
-    const std::string& body,
-    const std::unordered_map<std::string, std::string>& headers
-) : Message(version, body, headers), method_type_(method_type), url_(url) {}
-
-Request::Request(const Request& other) : Message(other) {
-    this->method_type_ = other.method_type_;
-    this->url_ = other.url_;
-}
-
-Request::~Request() {}
+    MethodTypes method_type,
+    std::string url,
+    std::string version,
+    std::string body,
+    Headers headers
+) : Message(std::move(version), std::move(body), std::move(headers)),
+    method_type_(method_type), url_(std::move(url)) {}
 
 MethodTypes Request::get_method_type() const {
     return this->method_type_;
 }
 
-std::string Request::get_url() const {
+const std::string& Request::get_url() const {
     return this->url_;
 }
 
+bool Request::is_keep_alive() const {
+    bool keep_alive = get_version() == "HTTP/1.1";
+    const Headers& headers = get_headers();
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers.name_id(i) != HeaderNames::CONNECTION) {
+            continue;
+        }
+        // The value is a comma separated list of tokens.
+        std::string_view value = headers.value(i);
+        size_t begin = 0;
+        while (begin < value.size()) {
+            size_t end = value.find(',', begin);
+            if (end == std::string_view::npos) {
+                end = value.size();
+            }
+            std::string_view token = value.substr(begin, end - begin);
+            size_t first = token.find_first_not_of(" \t");
+            size_t last = token.find_last_not_of(" \t");
+            if (first != std::string_view::npos) {
+                token = token.substr(first, last - first + 1);
+                if (token.size() == 5 && strncasecmp(token.data(), "close", 5) == 0) {
+                    return false;
+                }
+                if (token.size() == 10 && strncasecmp(token.data(), "keep-alive", 10) == 0) {
+                    keep_alive = true;
+                }
+            }
+            begin = end + 1;
+        }
+    }
+    return keep_alive;
+}
+
 std::string Request::to_string() const {
     std::string message = method_type_to_string(get_method_type()) + " " + get_url() + " " + get_version() + "\r\n";
-    std::unordered_map<std::string, std::string> headers = get_headers();
-    for (auto& header : headers) {
-        message += header.first + ": " + header.second + "\r\n";
-    }
+    message += get_headers().lines();
     message += "\r\n";
     message += get_body();
     return message;
 }
 
-Request& Request::operator=(const Request& other) {
-    this->method_type_ = other.method_type_;
-    this->url_ = other.url_;
-    Message::operator=(other);
+Response::Response() : Message("", "", {}), status_code_(StatusCodes::UNKNOWN) {}
+
+Response::Response(
+    StatusCodes status_code,
+    std::string version,
+    Headers headers,
+    std::string body
+) : Message(std::move(version), std::move(body), std::move(headers)),
+    status_code_(status_code), date_(date_header()) {}
+
+StatusCodes Response::get_status_code() const {
+    return this->status_code_;
+}
+
+Response& Response::set_header(HeaderNames name, std::string_view value) {
+    this->headers_.set(name, value);
     return *this;
 }
 
-Response::Response() : Message("", "", {}), status_code_(StatusCodes::UNKNOWN) {}
+Response& Response::set_header(std::string_view name, std::string_view value) {
+    this->headers_.set(name, value);
+    return *this;
+}
 
-Response::Response(
-    const StatusCodes& status_code,
-    const std::string& version,
-    const std::unordered_map<std::string, std::string>& headers,
-    const std::string& body
-) : Message(version, body, headers), status_code_(status_code) {}
+Response& Response::set_body(std::string body) {
+    this->body_ = std::move(body);
+    return *this;
+}
 
-Response::Response(const Response& other) : Message(other) {
-    this->status_code_ = other.status_code_;
+Response& Response::set_head(SharedBody head) {
+    this->head_ = std::move(head);
+    return *this;
 }
 
-Response::~Response() {}
+Response& Response::set_shared_body(SharedBody shared_body) {
+    this->shared_body_ = std::move(shared_body);
+    return *this;
+}
 
-StatusCodes Response::get_status_code() const {
-    return this->status_code_;
+Response& Response::set_file_body(FileBody file_body) {
+    this->file_body_ = std::move(file_body);
+    return *this;
+}
+
+const FileBody& Response::get_file_body() const {
+    return this->file_body_;
 }
 
-ssize_t Response::serialize(std::vector<uint8_t>& buffer) const {
-    std::string message = get_version() + " " + status_code_to_string(get_status_code()) + "\r\n";
-    for (auto& header : get_headers()) {
-        message += header.first + ": " + header.second + "\r\n";
+Response& Response::set_parts(std::vector<BodyPart> parts) {
+    this->parts_ = std::move(parts);
+    return *this;
+}
+
+// Append an iovec referencing bytes that outlive the send.
+static inline size_t push_iovec(std::vector<iovec>& iov, const char* data, size_t size) {
+    if (size > 0) {
+        iov.push_back({const_cast<char*>(data), size});
     }
-    message += "\r\n";
-    message += get_body();
-    buffer.resize(message.size());
-    std::copy(message.begin(), message.end(), buffer.begin());
-    return message.size();
+    return size;
+}
+
+size_t Response::serialize(std::vector<iovec>& iov, std::vector<FilePart>* files) const {
+    static const char crlf[] = "\r\n";
+    size_t size = 0;
+    if (head_.data != nullptr) {
+        size += push_iovec(iov, head_.data, head_.size);
+    } else {
+        std::string_view line = status_line(status_code_, version_);
+        size += push_iovec(iov, line.data(), line.size());
+        // The headers are kept serialized, in the order they are set.
+        std::string_view lines = headers_.lines();
+        size += push_iovec(iov, lines.data(), lines.size());
+    }
+    if (date_ != nullptr) {
+        size += push_iovec(iov, date_->data(), date_->size());
+    }
+    size += push_iovec(iov, crlf, 2);
+    if (shared_body_.data != nullptr) {
+        size += push_iovec(iov, shared_body_.data, shared_body_.size);
+    } else {
+        size += push_iovec(iov, body_.data(), body_.size());
+    }
+    if (files != nullptr && file_body_.length > 0) {
+        files->push_back({iov.size(), file_body_});
+    }
+    for (auto& part : parts_) {
+        size += push_iovec(iov, part.head.data(), part.head.size());
+        if (part.shared_body.data != nullptr) {
+            size += push_iovec(iov, part.shared_body.data, part.shared_body.size);
+        } else if (files != nullptr && part.file_body.length > 0) {
+            files->push_back({iov.size(), part.file_body});
+        }
+    }
+    return size;
 }
 
 std::string Response::to_string() const {
-    std::string message = get_version() + " " + status_code_to_string(get_status_code()) + "\r\n";
-    for (auto& header : get_headers()) {
-        message += header.first + ": " + header.second + "\r\n";
+    std::vector<iovec> iov;
+    std::string message;
+    message.reserve(serialize(iov));
+    for (auto& vec : iov) {
+        message.append(static_cast<const char*>(vec.iov_base), vec.iov_len);
     }
-    message += "\r\n";
-    message += get_body();
     return message;
 }
 
-Response& Response::operator=(const Response& other) {
-    this->status_code_ = other.status_code_;
-    Message::operator=(other);
-    return *this;
+CannedResponse::CannedResponse(
+    const StatusCodes& status_code,
+    const Headers& headers,
+    const std::string& body
+) : status_code_(status_code) {
+    // Lay out the four heads and the body in one block.
+    static const char* const versions[] = {"HTTP/1.0", "HTTP/1.1"};
+    static const char* const connections[] = {"close", "keep-alive"};
+    std::string fields(headers.lines());
+    fields += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+
+    std::string block;
+    size_t offsets[2][2];
+    size_t lengths[2][2];
+    for (int v = 0; v < 2; v++) {
+        for (int c = 0; c < 2; c++) {
+            offsets[v][c] = block.size();
+            block += status_line(status_code, versions[v]);
+            block += fields;
+            block += "Connection: " + std::string(connections[c]) + "\r\n";
+            lengths[v][c] = block.size() - offsets[v][c];
+        }
+    }
+    size_t body_offset = block.size();
+    block += body;
+
+    block_ = std::make_shared<const std::string>(std::move(block));
+    for (int v = 0; v < 2; v++) {
+        for (int c = 0; c < 2; c++) {
+            heads_[v][c] = std::string_view(block_->data() + offsets[v][c], lengths[v][c]);
+        }
+    }
+    body_ = std::string_view(block_->data() + body_offset, body.size());
+}
+
+StatusCodes CannedResponse::get_status_code() const {
+    return this->status_code_;
+}
+
+Response CannedResponse::respond(const std::string& version, bool keep_alive) const {
+    std::string_view head = heads_[version == "HTTP/1.0" ? 0 : 1][keep_alive ? 1 : 0];
+    Response response(status_code_, version);
+    response.set_head({block_, head.data(), head.size()})
+            .set_shared_body({block_, body_.data(), body_.size()});
+    return response;
 }
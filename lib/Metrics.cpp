@@ -0,0 +1,78 @@
+#include "Metrics.hpp"
+
+int Histogram::bucket_of(uint64_t value) {
+    // Values below 2^SUB_BITS have a bucket each, above that the bucket is
+    // the position of the highest bit and the SUB_BITS bits after it.
+    if (value < (1u << SUB_BITS)) {
+        return static_cast<int>(value);
+    }
+    int bit = 63 - __builtin_clzll(value);
+    if (bit >= MAX_BITS) {
+        return BUCKET_NUM - 1;
+    }
+    int sub = static_cast<int>(value >> (bit - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return ((bit - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+uint64_t Histogram::value_of(int bucket) {
+    if (bucket < (1 << SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> SUB_BITS) - 1;
+    uint64_t low = static_cast<uint64_t>((1 << SUB_BITS) + (bucket & ((1 << SUB_BITS) - 1))) << shift;
+    return low + (1ull << shift) / 2;
+}
+
+void Histogram::record(uint64_t value) {
+    buckets_[bucket_of(value)].add();
+    count_.add();
+    if (value > max_.get()) {
+        max_.set(value);
+    }
+}
+
+void Histogram::merge(const Histogram &other) {
+    for (int i = 0; i < BUCKET_NUM; i++) {
+        uint64_t n = other.buckets_[i].get();
+        if (n != 0) {
+            buckets_[i].add(n);
+        }
+    }
+    count_.add(other.count_.get());
+    if (other.max_.get() > max_.get()) {
+        max_.set(other.max_.get());
+    }
+}
+
+uint64_t Histogram::percentile(double percentile) const {
+    // Sum the buckets rather than trusting count_, a writer may be between
+    // updating a bucket and the count.
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKET_NUM; i++) {
+        total += buckets_[i].get();
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile / 100 * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_NUM; i++) {
+        seen += buckets_[i].get();
+        if (seen >= rank) {
+            uint64_t value = value_of(i);
+            return value < max() ? value : max();
+        }
+    }
+    return max();
+}
+
+uint64_t Histogram::count() const {
+    return count_.get();
+}
+
+uint64_t Histogram::max() const {
+    return max_.get();
+}
@@ -0,0 +1,78 @@
+#include "Mime.hpp"
+#include <algorithm>
+#include <cctype>
+
+struct MimeType {
+    std::string_view extension;
+    std::string type;
+};
+
+// Sorted by extension for the binary search.
+static const MimeType MIME_TYPES[] = {
+    {"avif", "image/avif"},
+    {"bmp", "image/bmp"},
+    {"css", "text/css"},
+    {"csv", "text/csv"},
+    {"gif", "image/gif"},
+    {"gz", "application/gzip"},
+    {"htm", "text/html"},
+    {"html", "text/html"},
+    {"ico", "image/x-icon"},
+    {"jpeg", "image/jpeg"},
+    {"jpg", "image/jpeg"},
+    {"js", "text/javascript"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"md", "text/markdown"},
+    {"mjs", "text/javascript"},
+    {"mp3", "audio/mpeg"},
+    {"mp4", "video/mp4"},
+    {"ogg", "audio/ogg"},
+    {"otf", "font/otf"},
+    {"pdf", "application/pdf"},
+    {"png", "image/png"},
+    {"svg", "image/svg+xml"},
+    {"ttf", "font/ttf"},
+    {"txt", "text/plain"},
+    {"wasm", "application/wasm"},
+    {"webm", "video/webm"},
+    {"webp", "image/webp"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"xml", "application/xml"},
+    {"zip", "application/zip"}
+};
+
+static const std::string DEFAULT_TYPE = "application/octet-stream";
+
+const std::string &mime_type(std::string_view path) {
+    // The extension is after the last dot of the last segment.
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string_view::npos || path[dot] != '.') {
+        return DEFAULT_TYPE;
+    }
+    std::string_view extension = path.substr(dot + 1);
+
+    // Lower the extension, the known ones are short.
+    char lower[8];
+    if (extension.empty() || extension.size() > sizeof(lower)) {
+        return DEFAULT_TYPE;
+    }
+    for (size_t i = 0; i < extension.size(); i++) {
+        lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(extension[i])));
+    }
+    extension = std::string_view(lower, extension.size());
+
+    auto it = std::lower_bound(
+        std::begin(MIME_TYPES),
+        std::end(MIME_TYPES),
+        extension,
+        [](const MimeType &mime, std::string_view key) {
+            return mime.extension < key;
+        }
+    );
+    if (it == std::end(MIME_TYPES) || it->extension != extension) {
+        return DEFAULT_TYPE;
+    }
+    return it->type;
+}
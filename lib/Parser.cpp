@@ -0,0 +1,289 @@
+#include "Parser.hpp"
+#include "Scan.hpp"
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+
+RequestParser::RequestParser() {
+    reset();
+}
+
+void RequestParser::reset() {
+    state_ = State::REQUEST_LINE;
+    line_start_ = 0;
+    scan_pos_ = 0;
+    data_ = nullptr;
+    method_ = target_ = version_ = Span();
+    header_num_ = 0;
+    head_length_ = 0;
+    content_length_ = 0;
+    has_content_length_ = false;
+    chunked_ = false;
+}
+
+std::string_view RequestParser::view(const Span &span) const {
+    return std::string_view(data_ + span.offset, span.length);
+}
+
+bool RequestParser::parse_request_line(size_t end) {
+    // method SP request-target SP HTTP-version
+    const char *begin = data_ + line_start_;
+    const char *last = data_ + end;
+    // The method is a token, the target has no SP or control chars.
+    const char *sp1 = scan_non_token(begin, last);
+    if (sp1 == begin || sp1 == last || *sp1 != ' ') {
+        return false;
+    }
+    const char *sp2 = scan_non_vchar(sp1 + 1, last);
+    if (sp2 == sp1 + 1 || sp2 == last || *sp2 != ' ') {
+        return false;
+    }
+    if (last - sp2 - 1 != 8 || memcmp(sp2 + 1, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+    method_ = {static_cast<uint32_t>(begin - data_), static_cast<uint32_t>(sp1 - begin)};
+    target_ = {static_cast<uint32_t>(sp1 + 1 - data_), static_cast<uint32_t>(sp2 - sp1 - 1)};
+    version_ = {static_cast<uint32_t>(sp2 + 1 - data_), 8};
+    return true;
+}
+
+bool RequestParser::parse_header(size_t end) {
+    // field-name ":" OWS field-value OWS
+    const char *begin = data_ + line_start_;
+    const char *last = data_ + end;
+    // The name is a token directly followed by ':', the value has no
+    // control chars but HTAB.
+    const char *colon = scan_non_token(begin, last);
+    if (colon == begin || colon == last || *colon != ':' || header_num_ == MAX_HEADER_NUM) {
+        return false;
+    }
+    if (scan_ctl(colon + 1, last) != last) {
+        return false;
+    }
+    const char *value = colon + 1;
+    while (value < last && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (last > value && (last[-1] == ' ' || last[-1] == '\t')) {
+        last--;
+    }
+    HeaderNames id = intern_header(std::string_view(begin, colon - begin));
+    header_ids_[header_num_] = id;
+    Header &header = headers_[header_num_++];
+    header.name = {static_cast<uint32_t>(begin - data_), static_cast<uint32_t>(colon - begin)};
+    header.value = {static_cast<uint32_t>(value - data_), static_cast<uint32_t>(last - value)};
+
+    // The framing of the body is needed to know where the request ends,
+    // an ambiguous one is refused as it could smuggle a request.
+    if (id == HeaderNames::CONTENT_LENGTH) {
+        if (value == last || last - value > 18) {
+            return false;
+        }
+        size_t length = 0;
+        for (const char *p = value; p != last; p++) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            length = length * 10 + (*p - '0');
+        }
+        if ((has_content_length_ && length != content_length_) || chunked_) {
+            return false;
+        }
+        content_length_ = length;
+        has_content_length_ = true;
+    } else if (id == HeaderNames::TRANSFER_ENCODING) {
+        // Only the chunked coding alone is supported.
+        if (last - value != 7 || strncasecmp(value, "chunked", 7) != 0 || chunked_ || has_content_length_) {
+            return false;
+        }
+        chunked_ = true;
+    }
+    return true;
+}
+
+ParseStatus RequestParser::parse(const char *data, size_t size) {
+    data_ = data;
+    while (state_ == State::REQUEST_LINE || state_ == State::HEADERS) {
+        // Find the end of the current line, resuming the previous scan.
+        const char *lf = scan_char(data_ + scan_pos_, data_ + size, '\n');
+        if (lf == data_ + size) {
+            scan_pos_ = size;
+            return ParseStatus::INCOMPLETE;
+        }
+        size_t next = lf - data_ + 1;
+        size_t end = lf - data_;
+        if (end > line_start_ && data_[end - 1] == '\r') {
+            end--;
+        }
+
+        if (state_ == State::REQUEST_LINE) {
+            if (!parse_request_line(end)) {
+                state_ = State::ERROR;
+                break;
+            }
+            state_ = State::HEADERS;
+        } else if (end == line_start_) {
+            // An empty line ends the headers.
+            head_length_ = next;
+            state_ = State::COMPLETE;
+        } else if (!parse_header(end)) {
+            state_ = State::ERROR;
+            break;
+        }
+        line_start_ = scan_pos_ = next;
+    }
+
+    switch (state_) {
+        case State::COMPLETE:
+            return ParseStatus::COMPLETE;
+        case State::ERROR:
+            return ParseStatus::ERROR;
+        default:
+            return ParseStatus::INCOMPLETE;
+    }
+}
+
+std::string_view RequestParser::method() const {
+    return view(method_);
+}
+
+std::string_view RequestParser::target() const {
+    return view(target_);
+}
+
+std::string_view RequestParser::version() const {
+    return view(version_);
+}
+
+size_t RequestParser::header_num() const {
+    return header_num_;
+}
+
+HeaderNames RequestParser::header_id(size_t index) const {
+    return header_ids_[index];
+}
+
+std::string_view RequestParser::header_name(size_t index) const {
+    return view(headers_[index].name);
+}
+
+std::string_view RequestParser::header_value(size_t index) const {
+    return view(headers_[index].value);
+}
+
+size_t RequestParser::head_length() const {
+    return head_length_;
+}
+
+size_t RequestParser::content_length() const {
+    return content_length_;
+}
+
+bool RequestParser::chunked() const {
+    return chunked_;
+}
+
+BodyDecoder::BodyDecoder() {
+    reset(0, false);
+}
+
+void BodyDecoder::reset(size_t content_length, bool chunked) {
+    state_ = chunked ? State::SIZE : content_length > 0 ? State::LENGTH : State::COMPLETE;
+    remaining_ = chunked ? 0 : content_length;
+    digits_ = 0;
+    line_size_ = 0;
+}
+
+// Get the value of a hex digit, -1 if it is not one.
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+        return (c | 0x20) - 'a' + 10;
+    }
+    return -1;
+}
+
+DecodeStatus BodyDecoder::decode(const char *data, size_t size, size_t &used, std::string_view &chunk) {
+    used = 0;
+    chunk = std::string_view();
+    while (used < size && state_ != State::COMPLETE && state_ != State::ERROR) {
+        if (state_ == State::LENGTH || state_ == State::DATA) {
+            // Hand out the data in place and stop there.
+            size_t length = std::min(remaining_, size - used);
+            chunk = std::string_view(data + used, length);
+            used += length;
+            remaining_ -= length;
+            if (remaining_ == 0) {
+                state_ = state_ == State::LENGTH ? State::COMPLETE : State::DATA_END;
+                digits_ = 0;
+            }
+            break;
+        }
+
+        // The framing is consumed a byte at a time, it is never buffered.
+        char c = data[used++];
+        switch (state_) {
+            case State::SIZE: {
+                int value = hex_value(c);
+                if (value >= 0 && digits_ < 15) {
+                    remaining_ = remaining_ * 16 + value;
+                    digits_++;
+                } else if (digits_ > 0 && (c == ';' || c == ' ' || c == '\t' || c == '\r')) {
+                    state_ = State::EXTENSION;
+                } else if (digits_ > 0 && c == '\n') {
+                    state_ = remaining_ > 0 ? State::DATA : State::TRAILER;
+                    digits_ = line_size_ = 0;
+                } else {
+                    state_ = State::ERROR;
+                }
+                break;
+            }
+            case State::EXTENSION:
+                if (c == '\n') {
+                    state_ = remaining_ > 0 ? State::DATA : State::TRAILER;
+                    digits_ = line_size_ = 0;
+                } else if (++line_size_ > MAX_CHUNK_LINE_SIZE) {
+                    state_ = State::ERROR;
+                }
+                break;
+            case State::DATA_END:
+                // CRLF, or a bare LF.
+                if (c == '\r' && digits_ == 0) {
+                    digits_ = 1;
+                } else if (c == '\n') {
+                    state_ = State::SIZE;
+                    remaining_ = digits_ = line_size_ = 0;
+                } else {
+                    state_ = State::ERROR;
+                }
+                break;
+            case State::TRAILER:
+                if (++line_size_ > MAX_CHUNK_LINE_SIZE) {
+                    state_ = State::ERROR;
+                } else if (c == '\n') {
+                    // An empty line ends the trailer.
+                    state_ = digits_ == 0 ? State::COMPLETE : State::TRAILER;
+                    digits_ = 0;
+                } else if (c != '\r') {
+                    digits_++;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    switch (state_) {
+        case State::COMPLETE:
+            return DecodeStatus::COMPLETE;
+        case State::ERROR:
+            return DecodeStatus::ERROR;
+        default:
+            return DecodeStatus::INCOMPLETE;
+    }
+}
+
+bool BodyDecoder::complete() const {
+    return state_ == State::COMPLETE;
+}
@@ -1,117 +1,242 @@
 #include "Receiver.hpp"
 #include <sys/socket.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 
-Receiver::Receiver(int sockfd) : sockfd_(sockfd), running_(true) {
-    buffer_.resize(MAX_BUFFER_SIZE);
+Receiver::Receiver(int sockfd, BufferPool &pool) :
+    sockfd_(sockfd), pool_(pool), buffer_(nullptr), capacity_(0), begin_(0), end_(0), in_body_(false) {}
+
+Receiver::~Receiver() {
+    if (buffer_ != nullptr && large_.empty()) {
+        pool_.release(buffer_);
+    }
+    pool_.track_large(large_.size(), 0);
 }
 
-Receiver::~Receiver() {}
+bool Receiver::make_room() {
+    if (buffer_ == nullptr) {
+        buffer_ = pool_.acquire();
+        if (buffer_ == nullptr) {
+            return false;
+        }
+        capacity_ = pool_.buffer_size();
+    }
 
-void Receiver::close() {
-    running_ = false;
+    // Move the pending bytes to the front.
+    // The parser keeps offsets from begin_, so moving the bytes is safe.
+    if (end_ == capacity_ && begin_ > 0) {
+        memmove(buffer_, buffer_ + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    return true;
 }
 
-bool Receiver::get_request(Request &request) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    // use epoll_wait to wait for the socket to be readable
-    int epollfd_ = epoll_create(MAX_EPOLL_EVENTS), nfds, content_length;
-    // add the socket to epoll
-    struct epoll_event event;
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = sockfd_;
-    if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, sockfd_, &event) == -1) {
-        std::string error_message = "epoll_ctl error: fd = " + std::to_string(sockfd_) +
-                                    ", errno = " + std::to_string(errno);
-        perror(error_message.c_str());
+bool Receiver::grow() {
+    if (buffer_ == nullptr || capacity_ >= MAX_REQUEST_SIZE) {
         return false;
     }
+    // The buffer leaves the pool, the pool still counts its bytes.
+    size_t old_size = large_.size();
+    capacity_ = std::min<size_t>(capacity_ * 2, MAX_REQUEST_SIZE);
+    if (large_.empty()) {
+        large_.resize(capacity_);
+        memcpy(large_.data(), buffer_, end_);
+        pool_.release(buffer_);
+    } else {
+        large_.resize(capacity_);
+    }
+    buffer_ = large_.data();
+    pool_.track_large(old_size, capacity_);
+    return true;
+}
 
-    // prepare variables
-    std::vector<struct epoll_event> events_(MAX_EPOLL_EVENTS);
-    MethodTypes method_type = MethodTypes::UNKNOWN;
-    std::string method, url, version, body;
-    std::unordered_map<std::string, std::string> headers;
-
+ReceiveStatus Receiver::receive() {
+    ReceiveStatus status = ReceiveStatus::AGAIN;
     while (true) {
-        while ((nfds = epoll_wait(epollfd_, events_.data(), MAX_EPOLL_EVENTS, TIMEOUT)) == 0) {
-            // if closed, return 0
-            if (!running_) {
-                return false;
-            }
-        }
-
-        // if epoll_wait returns 0, it means that the timeout expires
-        // if epoll_wait returns -1, it means that an error occurs
-        if (nfds == 0) {
-            continue;
+        if (!make_room()) {
+            return ReceiveStatus::ERROR;
         }
-        if (nfds == -1) {
-            std::string error_message = "epoll_wait error: nfds = " + std::to_string(nfds) +
-                                        ", errno = " + std::to_string(errno);
-            perror(error_message.c_str());
-            return false;
+        if (end_ == capacity_) {
+            // Let the bytes be consumed before reading more.
+            return ReceiveStatus::FULL;
         }
 
-        // receive the message
-        ssize_t size = recv(sockfd_, reinterpret_cast<void *>(buffer_.data()), MAX_BUFFER_SIZE, 0);
+        ssize_t size = recv(sockfd_, buffer_ + end_, capacity_ - end_, 0);
         if (size == -1) {
-            std::string error_message = "recv error: size = " + std::to_string(size) +
-                                        ", errno = " + std::to_string(errno);
-            perror(error_message.c_str());
-            return false;
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return status;
+            }
+            return ReceiveStatus::ERROR;
         }
         if (size == 0) {
             // if the peer has performed an orderly shutdown
-            return false;
+            return ReceiveStatus::CLOSED;
+        }
+        end_ += size;
+        status = ReceiveStatus::RECEIVED;
+    }
+}
+
+ReceiveStatus Receiver::receive(const char *data, size_t size, size_t &used) {
+    used = 0;
+    while (used < size) {
+        if (!make_room()) {
+            return ReceiveStatus::ERROR;
+        }
+        if (end_ == capacity_) {
+            // Let the bytes be consumed before appending more.
+            return ReceiveStatus::FULL;
         }
+        size_t count = std::min(size - used, capacity_ - end_);
+        memcpy(buffer_ + end_, data + used, count);
+        end_ += count;
+        used += count;
+    }
+    return ReceiveStatus::RECEIVED;
+}
 
-        // process the http request
-        remaining_ += std::string(buffer_.begin(), buffer_.begin() + size);
-        if (
-            method_type == MethodTypes::UNKNOWN &&
-            remaining_.find("\r\n\r\n") != std::string::npos
-        ) {
-            // parse the headers
-            int pos = remaining_.find("\r\n\r\n");
-            std::string header_string = remaining_.substr(0, pos);
-            remaining_ = remaining_.substr(pos + 4);
-            std::istringstream iss(header_string);
-            iss >> method >> url >> version >> std::ws;
-            std::string line;
-            while (std::getline(iss, line)) {
-                if (line == "") {
-                    break;
-                }
-                std::istringstream iss2(line);
-                std::string key, value;
-                iss2 >> key >> value;
-                headers.insert(std::make_pair(key.substr(0, key.size() - 1), value));
+ReceiveStatus Receiver::discard() {
+    begin_ = end_ = 0;
+    release_buffer();
+
+    // Borrow a buffer for the time of the call only.
+    char *buffer = pool_.acquire();
+    if (buffer == nullptr) {
+        return ReceiveStatus::ERROR;
+    }
+    ReceiveStatus status = ReceiveStatus::AGAIN;
+    while (true) {
+        ssize_t size = recv(sockfd_, buffer, pool_.buffer_size(), 0);
+        if (size == -1) {
+            if (errno == EINTR) {
+                continue;
             }
-            if (method == "GET") {
-                method_type = MethodTypes::GET;
-                break;
-            } else if (method == "POST") {
-                method_type = MethodTypes::POST;
-                if (headers.find("Content-Length") != headers.end()) {
-                    content_length = std::stoi(headers["Content-Length"]);
-                } else {
-                    content_length = 0;
-                }
-            } else {
-                break;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                status = ReceiveStatus::ERROR;
             }
+            break;
         }
-        if (method_type == MethodTypes::POST && remaining_.size() >= content_length) {
-            body = remaining_.substr(0, content_length);
-            remaining_ = remaining_.substr(content_length);
+        if (size == 0) {
+            status = ReceiveStatus::CLOSED;
             break;
         }
+        status = ReceiveStatus::RECEIVED;
+    }
+    pool_.release(buffer);
+    return status;
+}
+
+ReceiveStage Receiver::stage() const {
+    if (in_body_) {
+        return ReceiveStage::BODY;
+    }
+    return begin_ == end_ ? ReceiveStage::IDLE : ReceiveStage::HEADERS;
+}
+
+bool Receiver::get_request(Request &request) {
+    if (in_body_ || begin_ == end_) {
+        return false;
+    }
+    ParseStatus status = parser_.parse(buffer_ + begin_, end_ - begin_);
+    if (status == ParseStatus::INCOMPLETE && end_ - begin_ < MAX_REQUEST_SIZE) {
+        // Only a large head grows the buffer, a full buffer with bytes
+        // consumed before the head is compacted by the next receive.
+        if (end_ == capacity_ && begin_ == 0) {
+            grow();
+        }
+        return false;
+    }
+    if (status != ParseStatus::COMPLETE) {
+        // Malformed or too large, drop everything received.
+        request = Request();
+        parser_.reset();
+        decoder_.reset(0, false);
+        begin_ = end_ = 0;
+        return true;
     }
 
     // construct the message
-    request = Request(method_type, url, version, body, headers);
+    MethodTypes method_type = MethodTypes::UNKNOWN;
+    if (parser_.method() == "GET") {
+        method_type = MethodTypes::GET;
+    } else if (parser_.method() == "POST") {
+        method_type = MethodTypes::POST;
+    }
+    // The headers are copied from the buffer at once into a single string,
+    // the request outlives the buffer when its body spans several reads.
+    Headers headers;
+    headers.reserve(parser_.header_num(), parser_.head_length());
+    for (size_t i = 0; i < parser_.header_num(); i++) {
+        headers.add(parser_.header_id(i), parser_.header_name(i), parser_.header_value(i));
+    }
+    request = Request(
+        method_type,
+        std::string(parser_.target()),
+        std::string(parser_.version()),
+        std::string(),
+        std::move(headers)
+    );
+
+    // consume the head, the body follows
+    begin_ += parser_.head_length();
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+    }
+    decoder_.reset(parser_.content_length(), parser_.chunked());
+    in_body_ = !decoder_.complete();
+    parser_.reset();
     return true;
 }
+
+BodyStatus Receiver::get_body(std::string_view &chunk) {
+    while (in_body_) {
+        size_t used;
+        DecodeStatus status = decoder_.decode(buffer_ + begin_, end_ - begin_, used, chunk);
+        begin_ += used;
+        if (status == DecodeStatus::ERROR) {
+            // The framing is lost, drop everything received.
+            in_body_ = false;
+            begin_ = end_ = 0;
+            return BodyStatus::ERROR;
+        }
+        if (status == DecodeStatus::COMPLETE) {
+            in_body_ = false;
+        }
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+        if (!chunk.empty()) {
+            return BodyStatus::DATA;
+        }
+        if (used == 0 && in_body_) {
+            if (begin_ == 0 && end_ == capacity_) {
+                // A full buffer without a piece, the framing is too large.
+                in_body_ = false;
+                begin_ = end_ = 0;
+                return BodyStatus::ERROR;
+            }
+            return BodyStatus::AGAIN;
+        }
+    }
+    return BodyStatus::COMPLETE;
+}
+
+void Receiver::release_buffer() {
+    if (buffer_ == nullptr || begin_ != end_) {
+        return;
+    }
+    if (large_.empty()) {
+        pool_.release(buffer_);
+    } else {
+        pool_.track_large(large_.size(), 0);
+        std::vector<char>().swap(large_);
+    }
+    buffer_ = nullptr;
+    capacity_ = 0;
+    begin_ = end_ = 0;
+}
@@ -0,0 +1,254 @@
+#include "Router.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Hash a url 8 bytes at a time, it is hashed once per lookup.
+static uint64_t hash_url(std::string_view url) {
+    uint64_t hash = url.size() * 0x9e3779b97f4a7c15ull;
+    size_t i = 0;
+    for (; i + 8 <= url.size(); i += 8) {
+        uint64_t word;
+        memcpy(&word, url.data() + i, 8);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 29;
+    }
+    if (i < url.size()) {
+        uint64_t word = 0;
+        for (size_t j = i; j < url.size(); j++) {
+            word |= static_cast<uint64_t>(static_cast<unsigned char>(url[j])) << (8 * (j - i));
+        }
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Derive a hash per seed from the hash of a url (the splitmix64 finalizer).
+static uint64_t mix(uint64_t hash, uint64_t seed) {
+    hash ^= seed * 0x9e3779b97f4a7c15ull;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+// The smallest power of two not less than n.
+static size_t round_up(size_t n) {
+    size_t size = 1;
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+Router::Node *Router::insert(const std::string &url) {
+    Node *node = &root_;
+    size_t pos = 0;
+    while (pos < url.size()) {
+        // The children start with distinct chars.
+        auto it = std::find_if(
+            node->children.begin(),
+            node->children.end(),
+            [&](const std::unique_ptr<Node> &child) {
+                return child->label[0] == url[pos];
+            }
+        );
+        if (it == node->children.end()) {
+            node->children.push_back(std::make_unique<Node>());
+            node->children.back()->label = url.substr(pos);
+            return node->children.back().get();
+        }
+
+        // Split the edge where the url leaves it.
+        std::string &label = (*it)->label;
+        size_t common = 0;
+        while (common < label.size() && pos + common < url.size() && label[common] == url[pos + common]) {
+            common++;
+        }
+        if (common < label.size()) {
+            auto middle = std::make_unique<Node>();
+            middle->label = label.substr(0, common);
+            label.erase(0, common);
+            middle->children.push_back(std::move(*it));
+            *it = std::move(middle);
+        }
+        node = it->get();
+        pos += common;
+    }
+    return node;
+}
+
+void Router::add(MethodTypes method, MountTypes mount, const std::string &url, uint16_t id) {
+    int index = static_cast<int>(method);
+    if (index < 0 || index >= METHOD_NUM || url.empty() || url[0] != '/' || id == 0) {
+        throw std::invalid_argument("Router Add failed: invalid route " + url);
+    }
+    Node *node = insert(url);
+    uint16_t &slot = mount == MountTypes::EXACT ? node->exact[index] : node->prefix[index];
+    if (slot != 0) {
+        throw std::invalid_argument("Router Add failed: " + url + " is already routed");
+    }
+    slot = id;
+
+    // The perfect hash has to be built again.
+    seeds_.clear();
+    slots_.clear();
+}
+
+void Router::build() {
+    // Collect the urls of the exact routes.
+    std::vector<Slot> urls;
+    std::vector<std::pair<const Node *, std::string> > stack = {{&root_, ""}};
+    while (!stack.empty()) {
+        auto [node, url] = stack.back();
+        stack.pop_back();
+        url += node->label;
+        if (std::any_of(node->exact, node->exact + METHOD_NUM, [](uint16_t id) { return id != 0; })) {
+            urls.push_back({url, node});
+        }
+        for (auto &child : node->children) {
+            stack.emplace_back(child.get(), url);
+        }
+    }
+    seeds_.clear();
+    slots_.clear();
+    if (urls.empty()) {
+        return;
+    }
+
+    // Hash and displace: place the largest buckets first, each of them
+    // with the first seed sending its urls to free and distinct slots.
+    seeds_.resize(round_up(urls.size()));
+    slots_.resize(round_up(urls.size() * 2));
+    std::vector<std::vector<size_t> > buckets(seeds_.size());
+    std::vector<uint64_t> hashes(urls.size());
+    for (size_t i = 0; i < urls.size(); i++) {
+        hashes[i] = hash_url(urls[i].url);
+        buckets[(hashes[i] >> 32) & (seeds_.size() - 1)].push_back(i);
+    }
+    std::vector<size_t> order(buckets.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<size_t> placed;
+    for (size_t bucket : order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        uint32_t seed = 1;
+        for (;; seed++) {
+            if (seed == 0) {
+                throw std::runtime_error("Router Build failed: no perfect hash found");
+            }
+            placed.clear();
+            for (size_t i : buckets[bucket]) {
+                size_t slot = mix(hashes[i], seed) & (slots_.size() - 1);
+                if (
+                    slots_[slot].node != nullptr ||
+                    std::find(placed.begin(), placed.end(), slot) != placed.end()
+                ) {
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (placed.size() == buckets[bucket].size()) {
+                break;
+            }
+        }
+        seeds_[bucket] = seed;
+        for (size_t j = 0; j < placed.size(); j++) {
+            slots_[placed[j]] = std::move(urls[buckets[bucket][j]]);
+        }
+    }
+}
+
+const Router::Node *Router::find_exact(std::string_view path) const {
+    if (slots_.empty()) {
+        return nullptr;
+    }
+    uint64_t hash = hash_url(path);
+    uint32_t seed = seeds_[(hash >> 32) & (seeds_.size() - 1)];
+    if (seed == 0) {
+        return nullptr;
+    }
+    const Slot &slot = slots_[mix(hash, seed) & (slots_.size() - 1)];
+    return slot.node != nullptr && slot.url == path ? slot.node : nullptr;
+}
+
+RouteStatus Router::match(MethodTypes method, std::string_view target, RouteMatch &match) const {
+    // Strip the query string.
+    size_t length = 0;
+    while (length < target.size() && target[length] != '?' && target[length] != '#') {
+        length++;
+    }
+    std::string_view path = target.substr(0, length);
+    int index = static_cast<int>(method);
+    bool valid = index >= 0 && index < METHOD_NUM;
+    match = RouteMatch();
+    match.path = path;
+
+    // The fast path for the known urls.
+    const Node *exact = find_exact(path);
+    if (exact != nullptr && valid && exact->exact[index] != 0) {
+        match.id = exact->exact[index];
+        return RouteStatus::FOUND;
+    }
+
+    // Walk down the tree, keeping the longest prefix route.
+    const Node *node = &root_;
+    size_t pos = 0;
+    size_t prefix_length = 0;
+    unsigned allowed = 0;
+    exact = nullptr;
+    while (true) {
+        pos += node->label.size();
+        for (int i = 0; i < METHOD_NUM; i++) {
+            if (node->prefix[i] != 0) {
+                allowed |= 1u << i;
+            }
+        }
+        if (valid && node->prefix[index] != 0) {
+            match.id = node->prefix[index];
+            prefix_length = pos;
+        }
+        if (pos == path.size()) {
+            exact = node;
+            break;
+        }
+        const Node *next = nullptr;
+        for (auto &child : node->children) {
+            if (child->label[0] == path[pos]) {
+                if (path.compare(pos, child->label.size(), child->label) == 0) {
+                    next = child.get();
+                }
+                break;
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+        node = next;
+    }
+
+    if (exact != nullptr) {
+        if (valid && exact->exact[index] != 0) {
+            match.id = exact->exact[index];
+            return RouteStatus::FOUND;
+        }
+        for (int i = 0; i < METHOD_NUM; i++) {
+            if (exact->exact[i] != 0) {
+                allowed |= 1u << i;
+            }
+        }
+    }
+    if (match.id != 0) {
+        match.rest = path.substr(prefix_length);
+        return RouteStatus::FOUND;
+    }
+    match.allowed = allowed;
+    return allowed != 0 ? RouteStatus::METHOD_NOT_ALLOWED : RouteStatus::NOT_FOUND;
+}
@@ -0,0 +1,347 @@
+#include "Scan.hpp"
+#include <cstdint>
+#ifdef __x86_64__
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+// Token chars: any VCHAR except the delimiters "(),/:;<=>?@[\]{}
+static const char *const DELIMITERS = "\"(),/:;<=>?@[\\]{}";
+
+struct TokenTable {
+    bool token[256];
+
+    TokenTable() {
+        for (int c = 0; c < 256; c++) {
+            token[c] = c > 0x20 && c < 0x7f;
+        }
+        for (const char *p = DELIMITERS; *p != '\0'; p++) {
+            token[static_cast<unsigned char>(*p)] = false;
+        }
+    }
+};
+
+static const TokenTable TOKEN_TABLE;
+
+/*
+ * Scalar kernels, also used for the tails shorter than a vector.
+ */
+
+static const char *scalar_char(const char *begin, const char *end, char c) {
+    while (begin != end && *begin != c) {
+        begin++;
+    }
+    return begin;
+}
+
+static const char *scalar_non_token(const char *begin, const char *end) {
+    while (begin != end && TOKEN_TABLE.token[static_cast<unsigned char>(*begin)]) {
+        begin++;
+    }
+    return begin;
+}
+
+static const char *scalar_non_vchar(const char *begin, const char *end) {
+    while (begin != end) {
+        unsigned char c = *begin;
+        if (c <= 0x20 || c == 0x7f) {
+            break;
+        }
+        begin++;
+    }
+    return begin;
+}
+
+static const char *scalar_ctl(const char *begin, const char *end) {
+    while (begin != end) {
+        unsigned char c = *begin;
+        if ((c < 0x20 && c != '\t') || c == 0x7f) {
+            break;
+        }
+        begin++;
+    }
+    return begin;
+}
+
+#ifdef SCAN_X86
+
+/*
+ * SSE2 kernels, 16 bytes at a time. SSE2 is part of x86-64.
+ * A vector produces a mask with a bit set for every matching byte,
+ * the first match is the lowest bit set.
+ * A load never reads outside [begin, end): the tail shorter than a vector
+ * is scanned with one more load of the last 16 bytes, overlapping the bytes
+ * already scanned whose matches are shifted out, or by the scalar kernel
+ * if the whole range is shorter than a vector.
+ */
+
+template <typename Match, typename Tail>
+static inline const char *sse2_scan(const char *begin, const char *end, Match match, Tail tail) {
+    const char *start = begin;
+    for (; end - begin >= 16; begin += 16) {
+        int mask = match(_mm_loadu_si128(reinterpret_cast<const __m128i *>(begin)));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    if (begin == end || end - start < 16) {
+        return tail(begin, end);
+    }
+    int mask = match(_mm_loadu_si128(reinterpret_cast<const __m128i *>(end - 16))) >> (16 - (end - begin));
+    return mask != 0 ? begin + __builtin_ctz(mask) : end;
+}
+
+static inline __m128i sse2_le(__m128i v, char limit) {
+    // Unsigned v <= limit.
+    return _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(limit)), _mm_set1_epi8(limit));
+}
+
+static const char *sse2_char(const char *begin, const char *end, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    return sse2_scan(begin, end, [&](__m128i v) {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    }, [c](const char *b, const char *e) {
+        return scalar_char(b, e, c);
+    });
+}
+
+static inline __m128i sse2_in(__m128i v, char low, char high) {
+    // Unsigned low <= v <= high.
+    return sse2_le(_mm_sub_epi8(v, _mm_set1_epi8(low)), high - low);
+}
+
+static const char *sse2_non_token(const char *begin, const char *end) {
+    return sse2_scan(begin, end, [](__m128i v) {
+        // Not a VCHAR (<= 0x20 or >= 0x7f), or a delimiter:
+        // '"', "()", ',', '/', ":;<=>?@", "[\]", '{', '}'.
+        __m128i bad = _mm_or_si128(sse2_le(v, 0x20), sse2_in(v, 0x7f, '\xff'));
+        bad = _mm_or_si128(bad, sse2_in(v, '(', ')'));
+        bad = _mm_or_si128(bad, sse2_in(v, ':', '@'));
+        bad = _mm_or_si128(bad, sse2_in(v, '[', ']'));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('{')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+        return _mm_movemask_epi8(bad);
+    }, scalar_non_token);
+}
+
+static const char *sse2_non_vchar(const char *begin, const char *end) {
+    return sse2_scan(begin, end, [](__m128i v) {
+        __m128i bad = _mm_or_si128(sse2_le(v, 0x20), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+        return _mm_movemask_epi8(bad);
+    }, scalar_non_vchar);
+}
+
+static const char *sse2_ctl(const char *begin, const char *end) {
+    return sse2_scan(begin, end, [](__m128i v) {
+        __m128i ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), sse2_le(v, 0x1f));
+        __m128i bad = _mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+        return _mm_movemask_epi8(bad);
+    }, scalar_ctl);
+}
+
+/*
+ * AVX2 kernels, 32 bytes at a time, the tails are scanned like above,
+ * and a range shorter than 32 bytes by the SSE2 kernel. They are compiled for AVX2 only, and called only if the cpu
+ * supports it.
+ * The token check classifies every byte with two table lookups (vpshufb):
+ * the low nibble selects a bitmap of the high nibbles forming a token char,
+ * the high nibble selects its bit, bytes >= 0x80 have no bit.
+ */
+
+struct NibbleTables {
+    alignas(32) uint8_t low[32];
+    alignas(32) uint8_t high[32];
+
+    NibbleTables() {
+        for (int i = 0; i < 16; i++) {
+            low[i] = 0;
+            high[i] = high[i + 16] = i < 8 ? static_cast<uint8_t>(1 << i) : 0;
+        }
+        for (int c = 0; c < 128; c++) {
+            if (TOKEN_TABLE.token[c]) {
+                low[c & 0x0f] |= static_cast<uint8_t>(1 << (c >> 4));
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            low[i + 16] = low[i];
+        }
+    }
+};
+
+static const NibbleTables NIBBLE_TABLES;
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+template <typename Match, typename Tail>
+static inline const char *avx2_scan(const char *begin, const char *end, Match match, Tail tail) {
+    // GCC does not clear the upper halves of the ymm registers on its own
+    // in a function compiled for AVX2 by a pragma, and the legacy SSE code
+    // run after it, the SSE2 tail or the rest of the parser, would stall on
+    // them. vzeroupper is done on every way out.
+    const char *start = begin;
+    for (; end - begin >= 32; begin += 32) {
+        uint32_t mask = match(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin)));
+        if (mask != 0) {
+            _mm256_zeroupper();
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    if (begin == end || end - start < 32) {
+        _mm256_zeroupper();
+        return tail(begin, end);
+    }
+    uint32_t mask = match(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(end - 32))) >> (32 - (end - begin));
+    _mm256_zeroupper();
+    return mask != 0 ? begin + __builtin_ctz(mask) : end;
+}
+
+static inline __m256i avx2_le(__m256i v, char limit) {
+    // Unsigned v <= limit.
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(limit)), _mm256_set1_epi8(limit));
+}
+
+static const char *avx2_char(const char *begin, const char *end, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    return avx2_scan(begin, end, [&](__m256i v) {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+    }, [c](const char *b, const char *e) {
+        return sse2_char(b, e, c);
+    });
+}
+
+static const char *avx2_non_token(const char *begin, const char *end) {
+    const __m256i low_table = _mm256_load_si256(reinterpret_cast<const __m256i *>(NIBBLE_TABLES.low));
+    const __m256i high_table = _mm256_load_si256(reinterpret_cast<const __m256i *>(NIBBLE_TABLES.high));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    return avx2_scan(begin, end, [&](__m256i v) {
+        __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(v, nibble));
+        __m256i high = _mm256_shuffle_epi8(
+            high_table,
+            _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)
+        );
+        __m256i token = _mm256_and_si256(low, high);
+        return static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(token, _mm256_setzero_si256()))
+        );
+    }, sse2_non_token);
+}
+
+static const char *avx2_non_vchar(const char *begin, const char *end) {
+    return avx2_scan(begin, end, [](__m256i v) {
+        __m256i bad = _mm256_or_si256(avx2_le(v, 0x20), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(bad));
+    }, sse2_non_vchar);
+}
+
+static const char *avx2_ctl(const char *begin, const char *end) {
+    return avx2_scan(begin, end, [](__m256i v) {
+        __m256i ctl = _mm256_andnot_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+            avx2_le(v, 0x1f)
+        );
+        __m256i bad = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(bad));
+    }, sse2_ctl);
+}
+
+#pragma GCC pop_options
+
+#endif
+
+/*
+ * Runtime dispatch.
+ */
+
+struct ScanKernels {
+    ScanIsa isa;
+    const char *name;
+    const char *(*find_char)(const char *, const char *, char);
+    const char *(*non_token)(const char *, const char *);
+    const char *(*non_vchar)(const char *, const char *);
+    const char *(*ctl)(const char *, const char *);
+};
+
+static const ScanKernels SCALAR_KERNELS = {
+    ScanIsa::SCALAR, "scalar", scalar_char, scalar_non_token, scalar_non_vchar, scalar_ctl
+};
+
+#ifdef SCAN_X86
+static const ScanKernels SSE2_KERNELS = {
+    ScanIsa::SSE2, "sse2", sse2_char, sse2_non_token, sse2_non_vchar, sse2_ctl
+};
+static const ScanKernels AVX2_KERNELS = {
+    ScanIsa::AVX2, "avx2", avx2_char, avx2_non_token, avx2_non_vchar, avx2_ctl
+};
+#endif
+
+static bool supports(ScanIsa isa) {
+    switch (isa) {
+        case ScanIsa::SCALAR:
+            return true;
+#ifdef SCAN_X86
+        case ScanIsa::SSE2:
+            return true;
+        case ScanIsa::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+static const ScanKernels *kernels_of(ScanIsa isa) {
+    switch (isa) {
+#ifdef SCAN_X86
+        case ScanIsa::SSE2:
+            return &SSE2_KERNELS;
+        case ScanIsa::AVX2:
+            return &AVX2_KERNELS;
+#endif
+        default:
+            return &SCALAR_KERNELS;
+    }
+}
+
+static const ScanKernels *&selected() {
+    static const ScanKernels *kernels = kernels_of(scan_default_isa());
+    return kernels;
+}
+
+ScanIsa scan_default_isa() {
+    if (supports(ScanIsa::SSE2)) {
+        return ScanIsa::SSE2;
+    }
+    return ScanIsa::SCALAR;
+}
+
+bool scan_use(ScanIsa isa) {
+    if (!supports(isa)) {
+        return false;
+    }
+    selected() = kernels_of(isa);
+    return true;
+}
+
+const char *scan_isa_name() {
+    return selected()->name;
+}
+
+const char *scan_char(const char *begin, const char *end, char c) {
+    return selected()->find_char(begin, end, c);
+}
+
+const char *scan_non_token(const char *begin, const char *end) {
+    return selected()->non_token(begin, end);
+}
+
+const char *scan_non_vchar(const char *begin, const char *end) {
+    return selected()->non_vchar(begin, end);
+}
+
+const char *scan_ctl(const char *begin, const char *end) {
+    return selected()->ctl(begin, end);
+}
@@ -1,16 +1,154 @@
 #include "Sender.hpp"
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <climits>
+#include <cerrno>
+#include <algorithm>
 
-Sender::Sender(int sockfd) {
-    sockfd_ = sockfd;
-    buffer_.resize(MAX_BUFFER_SIZE);
-}
+Sender::Sender(int sockfd) : sockfd_(sockfd), queued_(0), sent_(0) {}
 
 Sender::~Sender() {}
 
-bool Sender::send_response(Response &response) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    ssize_t size = response.serialize(buffer_);
-    size = send(sockfd_, reinterpret_cast<void *>(buffer_.data()), size, 0);
-    return size != -1;
+size_t Sender::queue_response(Response &&response) {
+    // Serialize once the response is in place, the iovecs point into it.
+    queue_.emplace_back();
+    Segment &segment = queue_.back();
+    segment.response = std::move(response);
+    size_t size = segment.response.serialize(segment.iov, &segment.files);
+    for (auto &file : segment.files) {
+        size += file.file_body.length;
+    }
+    queued_ += size;
+    return size;
+}
+
+bool Sender::send_response(Response &&response) {
+    queue_response(std::move(response));
+    return flush() != SendStatus::ERROR;
+}
+
+void Sender::advance(size_t size) {
+    for (Segment &segment : queue_) {
+        size_t end = segment.iov_end();
+        while (segment.iov_index < end) {
+            iovec &vec = segment.iov[segment.iov_index];
+            if (size < vec.iov_len) {
+                vec.iov_base = static_cast<char *>(vec.iov_base) + size;
+                vec.iov_len -= size;
+                return;
+            }
+            size -= vec.iov_len;
+            segment.iov_index++;
+        }
+        if (size == 0 || segment.file_index < segment.files.size()) {
+            return;
+        }
+    }
+}
+
+void Sender::drop_sent() {
+    while (!queue_.empty() && queue_.front().sent()) {
+        queue_.pop_front();
+    }
+}
+
+size_t Sender::gather(iovec *batch, size_t size, bool &more) {
+    size_t batch_size = 0;
+    more = false;
+    for (Segment &segment : queue_) {
+        size_t count = std::min<size_t>(
+            segment.iov_end() - segment.iov_index,
+            size - batch_size
+        );
+        std::copy(
+            segment.iov.begin() + segment.iov_index,
+            segment.iov.begin() + segment.iov_index + count,
+            batch + batch_size
+        );
+        batch_size += count;
+        if (segment.file_index < segment.files.size()) {
+            more = true;
+            break;
+        }
+        if (batch_size == size) {
+            break;
+        }
+    }
+    return batch_size;
+}
+
+void Sender::complete(size_t size) {
+    sent_ += size;
+    advance(size);
+    drop_sent();
+}
+
+SendStatus Sender::flush() {
+    // The gathered iovecs of consecutive segments, on the stack so that
+    // an idle connection does not keep them.
+    iovec batch[IOV_MAX];
+    while (!queue_.empty()) {
+        // Send the serialized bytes up to the next file range.
+        bool more = false;
+        size_t batch_size = gather(batch, IOV_MAX, more);
+        if (batch_size > 0) {
+            msghdr msg = {};
+            msg.msg_iov = batch;
+            msg.msg_iovlen = batch_size;
+            ssize_t size = sendmsg(sockfd_, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+            if (size == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return SendStatus::PENDING;
+                }
+                return SendStatus::ERROR;
+            }
+            complete(size);
+            continue;
+        }
+
+        // Stream the file range, the kernel copies from the page cache.
+        Segment &segment = queue_.front();
+        FileBody &file = segment.files[segment.file_index].file_body;
+        ssize_t size = sendfile(
+            sockfd_,
+            file.fd,
+            &file.offset,
+            std::min<size_t>(file.length, SENDFILE_CHUNK_SIZE)
+        );
+        if (size == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return SendStatus::PENDING;
+            }
+            return SendStatus::ERROR;
+        }
+        if (size == 0) {
+            // The file is truncated, Content-Length cannot be honoured.
+            return SendStatus::ERROR;
+        }
+        file.length -= size;
+        sent_ += size;
+        if (file.length == 0) {
+            segment.file_index++;
+            drop_sent();
+        }
+    }
+    return SendStatus::DONE;
+}
+
+bool Sender::pending() const {
+    return !queue_.empty();
+}
+
+uint64_t Sender::queued() const {
+    return queued_;
+}
+
+uint64_t Sender::sent() const {
+    return sent_;
 }
@@ -0,0 +1,170 @@
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick) :
+    start_(std::chrono::steady_clock::now()), tick_(tick), current_(0), size_(0) {
+    for (int level = 0; level < LEVEL_NUM; level++) {
+        occupied_[level] = 0;
+        for (int slot = 0; slot < SLOT_NUM; slot++) {
+            slots_[level][slot].prev = slots_[level][slot].next = &slots_[level][slot];
+        }
+    }
+}
+
+uint64_t TimerWheel::tick_of(std::chrono::steady_clock::time_point time) const {
+    if (time <= start_) {
+        return 0;
+    }
+    return (time - start_) / tick_;
+}
+
+void TimerWheel::link(Timer &timer) {
+    // Find the lowest level covering the deadline, a slot of a level is
+    // only reused once the level has wrapped around.
+    uint64_t delta = timer.expire > current_ ? timer.expire - current_ : 0;
+    int level = 0;
+    while (level < LEVEL_NUM - 1 && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    uint64_t expire = timer.expire;
+    if (delta >= (1ull << (SLOT_BITS * LEVEL_NUM))) {
+        // Too far, park it in the last slot reachable, it cascades again.
+        expire = current_ + (1ull << (SLOT_BITS * LEVEL_NUM)) - 1;
+    }
+    if (expire <= current_) {
+        // Already due, expire it on the next tick.
+        expire = current_ + 1;
+    }
+    int slot = static_cast<int>(expire >> (SLOT_BITS * level)) & (SLOT_NUM - 1);
+
+    Timer &head = slots_[level][slot];
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+    occupied_[level] |= 1ull << slot;
+}
+
+void TimerWheel::unlink(Timer &timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    // A slot is empty when its sentinel points to itself.
+    if (timer.next == timer.prev) {
+        Timer *head = timer.next;
+        for (int level = 0; level < LEVEL_NUM; level++) {
+            if (head >= slots_[level] && head < slots_[level] + SLOT_NUM) {
+                occupied_[level] &= ~(1ull << (head - slots_[level]));
+                break;
+            }
+        }
+    }
+    timer.prev = timer.next = nullptr;
+}
+
+void TimerWheel::schedule(Timer &timer, std::chrono::milliseconds timeout, uint64_t data) {
+    if (timer.active()) {
+        unlink(timer);
+    } else {
+        size_++;
+    }
+    // Round up, a timer never expires before its deadline: the current tick
+    // has already begun, so it is not counted.
+    uint64_t ticks = (timeout.count() + tick_.count() - 1) / tick_.count();
+    timer.expire = tick_of(std::chrono::steady_clock::now()) + ticks + 1;
+    timer.data = data;
+    link(timer);
+}
+
+void TimerWheel::cancel(Timer &timer) {
+    if (timer.active()) {
+        unlink(timer);
+        size_--;
+    }
+}
+
+void TimerWheel::cascade(int level) {
+    int slot = static_cast<int>(current_ >> (SLOT_BITS * level)) & (SLOT_NUM - 1);
+    Timer &head = slots_[level][slot];
+    while (head.next != &head) {
+        Timer &timer = *head.next;
+        unlink(timer);
+        link(timer);
+    }
+}
+
+uint64_t TimerWheel::next_tick() const {
+    // The next tick is either the deadline of a timer of level 0, or the
+    // tick where a slot of a higher level is due to cascade.
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < LEVEL_NUM; level++) {
+        if (occupied_[level] == 0) {
+            continue;
+        }
+        int shift = SLOT_BITS * level;
+        int index = static_cast<int>(current_ >> shift) & (SLOT_NUM - 1);
+        uint64_t round = current_ >> (shift + SLOT_BITS) << (shift + SLOT_BITS);
+        // The slots after the current one are due in this round of the level,
+        // the others in the next round.
+        uint64_t later = index + 1 < SLOT_NUM ? occupied_[level] >> (index + 1) << (index + 1) : 0;
+        uint64_t tick;
+        if (later != 0) {
+            tick = round + (static_cast<uint64_t>(__builtin_ctzll(later)) << shift);
+        } else {
+            tick = round + (1ull << (shift + SLOT_BITS)) +
+                   (static_cast<uint64_t>(__builtin_ctzll(occupied_[level])) << shift);
+        }
+        if (tick < next) {
+            next = tick;
+        }
+    }
+    return next;
+}
+
+size_t TimerWheel::advance(std::vector<uint64_t> &expired) {
+    uint64_t now = tick_of(std::chrono::steady_clock::now());
+    size_t count = 0;
+    // Jump from a due tick to the next, the empty ticks are skipped.
+    while (size_ > 0) {
+        uint64_t next = next_tick();
+        if (next > now) {
+            break;
+        }
+        current_ = next;
+
+        // Cascade the levels which wrapped around, the highest first.
+        for (int level = LEVEL_NUM - 1; level > 0; level--) {
+            if ((current_ & ((1ull << (SLOT_BITS * level)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        // Expire the timers of the tick.
+        Timer &head = slots_[0][current_ & (SLOT_NUM - 1)];
+        while (head.next != &head) {
+            Timer &timer = *head.next;
+            unlink(timer);
+            size_--;
+            expired.push_back(timer.data);
+            count++;
+        }
+    }
+    // Nothing is due until now, so no slot is passed over.
+    if (now > current_) {
+        current_ = now;
+    }
+    return count;
+}
+
+int TimerWheel::next_timeout() const {
+    if (size_ == 0) {
+        return -1;
+    }
+    auto deadline = start_ + tick_ * next_tick();
+    auto now = std::chrono::steady_clock::now();
+    if (deadline <= now) {
+        return 0;
+    }
+    // Round up so the wait does not wake up just before the deadline.
+    return static_cast<int>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1
+    );
+}
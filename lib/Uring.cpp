@@ -0,0 +1,362 @@
+#include "Uring.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// The group of the provided buffers, the only one of an instance.
+static const uint16_t BUFFER_GROUP = 0;
+
+static inline int io_uring_setup(unsigned entries, io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static inline int io_uring_register(int fd, unsigned opcode, void *arg, unsigned arg_num) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, arg_num);
+}
+
+// The features the event loop relies on: the completions are never
+// dropped, the submissions are read once submitted, the sockets are polled
+// internally, and the wait takes a timeout while submitting.
+static const unsigned REQUIRED_FEATURES =
+    IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG;
+
+bool Uring::supported() {
+    static const bool result = [] {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = io_uring_setup(8, &params);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = (params.features & REQUIRED_FEATURES) == REQUIRED_FEATURES;
+
+        // The multishot recv came with the zero-copy send (6.0), the
+        // multishot accept and the cancellation by fd before it (5.19),
+        // so its opcode tells them all.
+        const uint8_t ops[] = {
+            IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_READ,
+            IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_PROVIDE_BUFFERS,
+            IORING_OP_SEND_ZC
+        };
+        size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::unique_ptr<char[]> memory(new char[size]());
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(memory.get());
+        if (ok && io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+            for (uint8_t op : ops) {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    ok = false;
+                }
+            }
+        } else {
+            ok = false;
+        }
+        close(fd);
+        return ok;
+    }();
+    return result;
+}
+
+Uring::Uring(unsigned entries, unsigned buffer_num, size_t buffer_size) :
+    sq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_(MAP_FAILED), cq_ring_size_(0),
+    sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)), sqes_size_(0), sq_local_tail_(0),
+    buffers_(static_cast<char *>(MAP_FAILED)), buffer_size_(buffer_size), buffer_num_(buffer_num) {
+    // Only the calling thread submits, so the kernel runs the completion
+    // work when it waits instead of interrupting it, fall back to the plain
+    // ring on the kernels before 6.1.
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+                   IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+    ringfd_ = io_uring_setup(entries, &params);
+    if (ringfd_ < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        ringfd_ = io_uring_setup(entries, &params);
+    }
+    if (ringfd_ < 0) {
+        std::string error_msg = "Uring Init failed: failed to create an io_uring instance. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+    features_ = params.features;
+    if ((features_ & REQUIRED_FEATURES) != REQUIRED_FEATURES) {
+        close(ringfd_);
+        throw std::runtime_error("Uring Init failed: the kernel lacks a required io_uring feature.");
+    }
+
+    // Map the rings.
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size_ > sq_ring_size_) {
+            sq_ring_size_ = cq_ring_size_;
+        }
+        cq_ring_size_ = 0;
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ != MAP_FAILED) {
+        cq_ring_ = cq_ring_size_ == 0 ? sq_ring_ : mmap(
+            nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING
+        );
+    }
+    if (cq_ring_ != MAP_FAILED) {
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe *>(mmap(
+            nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES
+        ));
+    }
+    if (sqes_ == MAP_FAILED) {
+        int error = errno;
+        unmap();
+        close(ringfd_);
+        std::string error_msg = "Uring Init failed: failed to map the rings. errno: " +
+                                std::to_string(error) + " " + strerror(error);
+        throw std::runtime_error(error_msg);
+    }
+
+    char *sq = static_cast<char *>(sq_ring_);
+    char *cq = static_cast<char *>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sq_local_tail_ = *sq_tail_;
+    // The submissions are used in order, so the indirection array is fixed.
+    unsigned *sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; i++) {
+        sq_array[i] = i;
+    }
+
+    // Provide the receive buffers. The buffer rings registered by address
+    // (IORING_REGISTER_PBUF_RING) would save the submissions which give
+    // them back, but some kernels never pick a buffer from them.
+    buffers_ = static_cast<char *>(mmap(
+        nullptr, buffer_num_ * buffer_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    ));
+    if (buffers_ == MAP_FAILED) {
+        int error = errno;
+        unmap();
+        close(ringfd_);
+        std::string error_msg = "Uring Init failed: failed to map the receive buffers. errno: " +
+                                std::to_string(error) + " " + strerror(error);
+        throw std::runtime_error(error_msg);
+    }
+    recycled_.reserve(buffer_num_);
+    prepare_provide(0, buffer_num_);
+}
+
+Uring::~Uring() {
+    // Closing the ring cancels the operations left.
+    close(ringfd_);
+    unmap();
+}
+
+void Uring::unmap() {
+    if (buffers_ != MAP_FAILED) {
+        munmap(buffers_, buffer_num_ * buffer_size_);
+    }
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+}
+
+void Uring::prepare_provide(uint16_t id, unsigned num) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = num;
+    sqe->addr = reinterpret_cast<uint64_t>(buffers_ + id * buffer_size_);
+    sqe->len = buffer_size_;
+    sqe->off = id;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->flags = features_ & IORING_FEAT_CQE_SKIP ? IOSQE_CQE_SKIP_SUCCESS : 0;
+    sqe->user_data = INTERNAL_DATA;
+}
+
+void Uring::provide_recycled() {
+    std::sort(recycled_.begin(), recycled_.end());
+    size_t begin = 0;
+    for (size_t i = 1; i <= recycled_.size(); i++) {
+        if (i == recycled_.size() || recycled_[i] != recycled_[i - 1] + 1) {
+            prepare_provide(recycled_[begin], i - begin);
+            begin = i;
+        }
+    }
+    recycled_.clear();
+}
+
+io_uring_sqe *Uring::get_sqe() {
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        // The kernel consumes every submission it is given.
+        if (!submit()) {
+            std::string error_msg = "Uring Get SQE failed: failed to submit. errno: " +
+                                    std::to_string(errno) + " " + strerror(errno);
+            throw std::runtime_error(error_msg);
+        }
+    }
+    io_uring_sqe *sqe = &sqes_[sq_local_tail_ & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_local_tail_++;
+    return sqe;
+}
+
+void Uring::prepare_accept(int fd, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_recv(int fd, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_sendmsg(int fd, const msghdr *msg, int flags, bool link, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_read(int fd, void *buffer, size_t size, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = size;
+    sqe->off = -1;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_poll(int fd, uint32_t events, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_cancel(uint64_t target, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->flags = features_ & IORING_FEAT_CQE_SKIP ? IOSQE_CQE_SKIP_SUCCESS : 0;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_cancel_fd(int fd, uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->flags = features_ & IORING_FEAT_CQE_SKIP ? IOSQE_CQE_SKIP_SUCCESS : 0;
+    sqe->user_data = data;
+}
+
+void Uring::prepare_cancel_all(uint64_t data) {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    sqe->flags = features_ & IORING_FEAT_CQE_SKIP ? IOSQE_CQE_SKIP_SUCCESS : 0;
+    sqe->user_data = data;
+}
+
+bool Uring::submit() {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    while (true) {
+        unsigned to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (to_submit == 0) {
+            return true;
+        }
+        if (io_uring_enter(ringfd_, to_submit, 0, 0, nullptr, 0) < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+int Uring::wait(std::vector<io_uring_cqe> &cqes, int timeout) {
+    provide_recycled();
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    // Submit and wait at once, or only submit if completions are ready.
+    // The completion work of the kernel runs in this call too.
+    if (head == tail || to_submit > 0) {
+        __kernel_timespec ts;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        unsigned min_complete = head == tail ? 1 : 0;
+        if (min_complete > 0 && timeout >= 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        int ret;
+        do {
+            to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            ret = io_uring_enter(
+                ringfd_, to_submit, min_complete,
+                IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)
+            );
+        } while (ret == -1 && errno == EINTR);
+        // A timeout is no error, nor a full completion ring, which is
+        // flushed once the ready completions are reaped.
+        if (ret == -1 && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+            return -1;
+        }
+        tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    }
+
+    size_t count = 0;
+    while (head != tail && count < cqes.size()) {
+        cqes[count++] = cqes_[head & cq_mask_];
+        head++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+const char *Uring::buffer(uint16_t id) const {
+    return buffers_ + id * buffer_size_;
+}
+
+void Uring::recycle(uint16_t id) {
+    recycled_.push_back(id);
+}
@@ -0,0 +1,174 @@
+#include "WorkerPool.hpp"
+#include <algorithm>
+
+// The pool and the index of the calling worker, nullptr for other threads.
+static thread_local WorkerPool *current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+WorkerPool::WorkerPool(size_t worker_num, size_t queue_size) :
+    queue_size_(queue_size), running_(true), queued_(0), sleeping_(0), rejected_(0) {
+    if (worker_num == 0) {
+        worker_num = 1;
+    }
+    // Every deque exists before a worker may steal from it.
+    for (size_t i = 0; i < worker_num; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_num; i++) {
+        workers_[i]->thread = std::thread(&WorkerPool::work, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wakeup_.notify_all();
+    for (auto &worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void WorkerPool::work(size_t index) {
+    current_pool = this;
+    current_index = index;
+    Worker &worker = *workers_[index];
+    while (true) {
+        Task *task = find_task(index);
+        if (task != nullptr) {
+            task->run();
+            worker.executed.add();
+            continue;
+        }
+
+        // Sleep until a task is queued. The count is checked after being
+        // counted as sleeping, and a submitter checks the sleepers after
+        // counting its task, so one of them always sees the other.
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_++;
+        while (running_ && queued_ == 0) {
+            wakeup_.wait(lock);
+        }
+        sleeping_--;
+        if (!running_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+Task *WorkerPool::find_task(size_t index) {
+    if (queued_ == 0) {
+        return nullptr;
+    }
+    Task *task = nullptr;
+    Worker &worker = *workers_[index];
+    if (worker.deque.pop(task)) {
+        queued_--;
+        return task;
+    }
+    size_t moved = 0;
+    {
+        // Take a share of the injected tasks at once, the rest of the share
+        // goes to the own deque, where the idle workers steal it.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!injected_.empty()) {
+            task = injected_.front();
+            injected_.pop_front();
+            queued_--;
+            size_t share = std::min<size_t>(injected_.size() / workers_.size(), WORKER_DEQUE_SIZE / 2);
+            while (moved < share && worker.deque.push(injected_.front())) {
+                injected_.pop_front();
+                moved++;
+            }
+        }
+    }
+    if (task != nullptr) {
+        // The moved tasks wait behind this one, wake a sleeper to steal them.
+        if (moved > 0) {
+            notify();
+        }
+        return task;
+    }
+    // Steal from the next workers first, so the thieves spread out.
+    for (size_t i = 1; i < workers_.size(); i++) {
+        Worker &victim = *workers_[(index + i) % workers_.size()];
+        if (victim.deque.steal(task)) {
+            worker.stolen.add();
+            queued_--;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void WorkerPool::notify() {
+    if (sleeping_ > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wakeup_.notify_one();
+    }
+}
+
+bool WorkerPool::submit(Task *task) {
+    bool worker = current_pool == this;
+    if (worker) {
+        queued_++;
+        if (workers_[current_index]->deque.push(task)) {
+            notify();
+            return true;
+        }
+        queued_--;
+    }
+
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        full = injected_.size() >= queue_size_;
+        if (!full) {
+            injected_.push_back(task);
+            queued_++;
+        }
+    }
+    if (!full) {
+        notify();
+        return true;
+    }
+    // A worker cannot wait for the others, it runs the task itself.
+    if (worker) {
+        task->run();
+        workers_[current_index]->executed.add();
+        return true;
+    }
+    rejected_++;
+    return false;
+}
+
+size_t WorkerPool::size() const {
+    return workers_.size();
+}
+
+size_t WorkerPool::queued() const {
+    return queued_;
+}
+
+uint64_t WorkerPool::executed() const {
+    uint64_t executed = 0;
+    for (auto &worker : workers_) {
+        executed += worker->executed.get();
+    }
+    return executed;
+}
+
+uint64_t WorkerPool::stolen() const {
+    uint64_t stolen = 0;
+    for (auto &worker : workers_) {
+        stolen += worker->stolen.get();
+    }
+    return stolen;
+}
+
+uint64_t WorkerPool::rejected() const {
+    return rejected_;
+}
@@ -0,0 +1,299 @@
+#ifndef __REACTOR_HPP__
+#define __REACTOR_HPP__
+
+#include "Server.hpp"
+
+class Reactor;
+
+// A request which may block, handled by the workers. It comes back to its
+// reactor with the response, as its own completion.
+struct RequestTask : public Task {
+    Server &server;
+    Reactor &reactor;
+    uint64_t client_id;
+    Request request;
+    bool keep_alive;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point parsed;
+    std::chrono::steady_clock::time_point handled;
+    Response response;
+    uint16_t route_id;
+
+    RequestTask(Server &server, Reactor &reactor, uint64_t client_id) :
+        server(server), reactor(reactor), client_id(client_id), keep_alive(false), route_id(0) {}
+
+    void run() override;
+};
+
+class Reactor {
+private:
+    Server &server_;
+    size_t reactor_id_;
+    int cpu_;
+    int sockfd_;
+    int eventfd_;
+    int spare_fd_;
+    std::atomic_bool running_;
+    IoBackends backend_;
+    // The epoll instance owns this reactor's listening socket,
+    // the wakeup eventfd and every client socket of this reactor.
+    std::unique_ptr<Epoll> epoll_;
+    // Created by the reactor thread for the io_uring backend, since only
+    // the thread which creates a ring submits to it.
+    std::unique_ptr<Uring> uring_;
+    std::thread thread_;
+    // The receive buffers lent to the clients, declared before them
+    // so that the clients give them back before it is destroyed.
+    BufferPool buffers_;
+    // Only touched by the reactor thread, so no lock is needed.
+    Slab<ClientInfo> clients_;
+    // The deadlines of the clients, the timers carry the client ids.
+    TimerWheel timers_;
+    std::vector<uint64_t> expired_;
+    ReactorStats stats_;
+    // The counter of the eventfd, read by io_uring to wake up.
+    uint64_t wakeup_value_;
+    // The messages of the linked sends prepared since the last submission,
+    // the kernel reads them when they are submitted.
+    struct SendSlot {
+        msghdr msg;
+        iovec iov[URING_SEND_IOV_NUM];
+    };
+    std::vector<SendSlot> send_slots_;
+    size_t send_slot_num_;
+    // The io_uring operations in flight, drained before the ring is closed.
+    size_t operations_;
+    // The requests handled by the workers, posted back by them, the first
+    // one of a batch writes the eventfd to wake the reactor up.
+    std::mutex tasks_mutex_;
+    std::vector<RequestTask *> tasks_;
+    std::vector<RequestTask *> finished_;
+
+    /*
+     * Run the event loop of the backend until the reactor stops.
+     */
+    void event_loop();
+
+    /*
+     * Wait for readiness events and dispatch them until the reactor stops.
+     */
+    void epoll_loop();
+
+    /*
+     * Submit the operations and dispatch their completions until the
+     * reactor stops, then cancel what is left in flight.
+     */
+    void uring_loop();
+
+    /*
+     * Accept all the pending connections on the listening socket.
+     */
+    void accept_clients();
+
+    /*
+     * Add an accepted connection, with the deadline of its first request.
+     * @param sockfd The socket of the connection.
+     * @param addr The address of the client.
+     * @return The id of the client, or INVALID_ID if the connection table
+     * is full and the socket is closed.
+     */
+    uint64_t add_client(int sockfd, const sockaddr_in &addr);
+
+    /*
+     * Accept and drop a pending connection with the spare fd, when the
+     * process is out of fds.
+     */
+    void drop_connection();
+
+    /*
+     * Drive a client connection after a readiness event.
+     * Receive and parse the buffered bytes, handle the complete requests
+     * and flush the responses, then re-arm or close the connection.
+     * @param client_id The id of the client.
+     * @param events The ready epoll events.
+     */
+    void handle_client(uint64_t client_id, uint32_t events);
+
+    /*
+     * Handle the complete requests in the receive buffer of a client
+     * (pipelining), their responses are queued in order. A request body
+     * is passed to its route as it arrives, so the request may stay
+     * pending until more bytes are received.
+     * @param client The client.
+     */
+    void handle_requests(uint64_t client_id, ClientInfo *client);
+
+    /*
+     * Account and queue the response to a request, to be logged once it is
+     * sent, and get ready for the next request of the client.
+     * @param client The client.
+     * @param request The request.
+     * @param response The response.
+     * @param route_id The id of the route, for the statistics and the log.
+     * @param keep_alive Whether the connection is kept open after the response.
+     * @param start When the request began to be parsed.
+     * @param parsed When its head and body were received.
+     * @param handled When its response was ready.
+     */
+    void finish_request(
+        ClientInfo *client,
+        const Request &request,
+        Response &&response,
+        uint16_t route_id,
+        bool keep_alive,
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point parsed,
+        std::chrono::steady_clock::time_point handled
+    );
+
+    /*
+     * Log the responses of a client sent since the last call, and count
+     * their bytes in the statistics of their routes.
+     * @param client The client.
+     * @param closed Whether the connection is closed, the responses not
+     * sent completely are then logged with the bytes sent of them.
+     */
+    void log_sent(ClientInfo *client, bool closed);
+
+    /*
+     * Hand a request which may block to the workers, the next requests of
+     * the client wait until its response is back.
+     * @param client_id The id of the client.
+     * @param client The client.
+     * @param keep_alive Whether the connection is kept open after the response.
+     * @param start When the request began to be parsed.
+     * @param parsed When its head and body were received.
+     * @return false if the workers are busy and the request is to be handled
+     * inline, true otherwise.
+     */
+    bool submit_request(
+        uint64_t client_id,
+        ClientInfo *client,
+        bool keep_alive,
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point parsed
+    );
+
+    /*
+     * Queue the responses of the requests handled by the workers since the
+     * last wakeup, and resume their clients.
+     */
+    void finish_tasks();
+
+    /*
+     * Dispatch an io_uring completion.
+     * @param cqe The completion.
+     */
+    void handle_completion(const io_uring_cqe &cqe);
+
+    /*
+     * Append the bytes of an io_uring recv to the receive buffer of a
+     * client, handling the requests whenever the buffer is full.
+     * @param client The client.
+     * @param data The bytes, in a provided buffer.
+     * @param size The number of bytes.
+     * @return false if no receive buffer can be borrowed.
+     */
+    bool receive_bytes(ClientInfo *client, const char *data, size_t size);
+
+    /*
+     * Drive a client after an io_uring completion, as handle_client does
+     * after a readiness event: handle the received requests, send the
+     * responses, then receive again or close the connection.
+     * @param client The client.
+     */
+    void resume_client(ClientInfo *client);
+
+    /*
+     * Prepare the sends of the queued responses of a client, as linked
+     * sendmsg operations. A file range is sent with sendfile instead, once
+     * the socket is writable.
+     * @param client The client.
+     * @return false if the socket fails, true otherwise.
+     */
+    bool send_responses(ClientInfo *client);
+
+    /*
+     * Arm the multishot recv of a client, if it is not armed.
+     * @param client The client.
+     */
+    void arm_receive(ClientInfo *client);
+
+    /*
+     * Free a closed client once none of its operations is in flight.
+     * @param client The client.
+     */
+    void release_client(ClientInfo *client);
+
+    /*
+     * Schedule the deadline of a client for what it is waiting for:
+     * the socket to drain, the rest of the request or the next request.
+     * @param client_id The id of the client.
+     * @param client The client.
+     */
+    void schedule_timeout(uint64_t client_id, ClientInfo *client);
+
+    /*
+     * Close the connections whose deadline has passed.
+     */
+    void expire_clients();
+
+    /*
+     * Remove a client and close its socket. With io_uring, its operations
+     * in flight are cancelled and it is freed once they complete.
+     * @param client_id The id of the client.
+     */
+    void close_client(uint64_t client_id);
+
+public:
+    /*
+     * Create a reactor with its own SO_REUSEPORT listening socket.
+     * @param server The server handling the requests.
+     * @param reactor_id The id of the reactor.
+     * @param addr The address and port to listen on.
+     * @param cpu The cpu to pin the reactor thread to, -1 to not pin.
+     * @param route_num The number of route ids, for the statistics.
+     * @param huge_pages Whether to back the receive buffers with huge pages.
+     * @param backend EPOLL or URING, the reactor falls back to epoll if it
+     * cannot create its ring.
+     */
+    Reactor(Server &server, size_t reactor_id, const sockaddr_in &addr, int cpu, size_t route_num, bool huge_pages, IoBackends backend);
+    ~Reactor();
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    /*
+     * Start the reactor thread.
+     */
+    void start();
+
+    /*
+     * Ask the reactor thread to stop, it returns after the current events.
+     */
+    void stop();
+
+    /*
+     * Wait for the reactor thread to return.
+     */
+    void join();
+
+    /*
+     * Post a request handled by a worker back to the reactor thread.
+     * Called by the worker threads.
+     * @param task The request, with its response.
+     */
+    void complete(RequestTask *task);
+
+    /*
+     * Get the statistics, recorded by the reactor thread while read.
+     */
+    const ReactorStats &get_stats() const;
+
+    /*
+     * Get the pool of the receive buffers, its counters are read only.
+     */
+    const BufferPool &get_buffers() const;
+};
+
+#endif
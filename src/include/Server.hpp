@@ -5,8 +5,19 @@
 #include "Message.hpp"
 #include "Receiver.hpp"
 #include "Sender.hpp"
+#include "BufferPool.hpp"
+#include "Epoll.hpp"
+#include "Uring.hpp"
+#include "AssetCache.hpp"
+#include "Router.hpp"
+#include "Form.hpp"
+#include "AccessLog.hpp"
+#include "Stats.hpp"
+#include "TimerWheel.hpp"
 #include "Map.hpp"
+#include "Slab.hpp"
 #include "Queue.hpp"
+#include "WorkerPool.hpp"
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -14,101 +25,309 @@
 #include <unordered_map>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 #include <thread>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <optional>
 
-#define get_client_addr(client_id, lock)\
-    std::string(\
-        inet_ntoa(clientinfo_list_->at((client_id), (lock))->get_addr().sin_addr)\
-    ) +\
-    ":" +\
-    std::to_string(\
-        ntohs(clientinfo_list_->at((client_id), (lock))->get_addr().sin_port)\
-    )
-
-enum class FileTypes {
-    HTML,
-    JPG,
-    ICO,
-    TXT
+/*
+ * Format a client address as "ip:port".
+ * @param addr The address of the client.
+ * @return std::string The formatted address.
+ */
+std::string get_client_addr(const sockaddr_in &addr);
+
+// What a route serves, the Content-Type of a file comes from its extension.
+enum class RouteTypes {
+    FILE,       // The file at path.
+    DIRECTORY,  // The files under the directory at path, for a prefix mount.
+    HANDLER,    // The response of the handler of the route.
+    STATS       // The statistics of the server as JSON.
 };
 
-struct File {
-    FileTypes type;
-    std::string path;
-    bool is_post = false;
+// The fixed responses of the server, serialized once at startup.
+enum class CannedPages {
+    BAD_REQUEST,
+    LOGIN_SUCCESS,
+    LOGIN_FAILED,
+    NOT_FOUND,
+    CONTENT_TOO_LARGE,
+    UNSUPPORTED_MEDIA_TYPE,
+    EXPECTATION_FAILED,
+    INTERNAL_SERVER_ERROR
 };
 
-std::string get_file_type(FileTypes type);
+/*
+ * What a handler is given to answer a request.
+ * The query parameters and the form fields of the body are parsed on the
+ * first access only, and their views point into the request, so a handler
+ * reading a few fields allocates nothing but its response.
+ * Only valid during the call to the handler.
+ */
+class RequestContext {
+private:
+    const Request &request_;
+    const RouteMatch &match_;
+    bool keep_alive_;
+    const std::vector<CannedResponse> &canned_;
+    Form query_;
+    Form form_;
+
+public:
+    /*
+     * Constructor.
+     * @param request The request, with its body.
+     * @param match The route of the request.
+     * @param keep_alive Whether the connection is kept open after the response.
+     * @param canned The fixed responses, indexed by CannedPages.
+     */
+    RequestContext(
+        const Request &request,
+        const RouteMatch &match,
+        bool keep_alive,
+        const std::vector<CannedResponse> &canned
+    );
+
+    RequestContext(const RequestContext &) = delete;
+    RequestContext &operator=(const RequestContext &) = delete;
+
+    const Request &get_request() const;
+
+    /*
+     * Get the path of the request, without the query string.
+     */
+    std::string_view get_path() const;
+
+    /*
+     * Get the part of the path after the url of a prefix route.
+     */
+    std::string_view get_rest() const;
+
+    /*
+     * Get the parameters of the query string, decoded.
+     */
+    Form &get_query();
+
+    /*
+     * Get the fields of an application/x-www-form-urlencoded body, decoded.
+     */
+    Form &get_form();
+
+    /*
+     * Answer with a body, Content-Length and Connection are set.
+     * More headers may be set on the response before returning it.
+     * @param status_code The status code.
+     * @param content_type The Content-Type of the body.
+     * @param body The body.
+     * @return The response.
+     */
+    Response respond(StatusCodes status_code, std::string_view content_type, std::string body) const;
+
+    /*
+     * Answer with a fixed response.
+     * @param page The response.
+     * @return The response, sharing the pre-serialized bytes.
+     */
+    Response respond(CannedPages page) const;
+};
+
+// Answers the requests of a route, called by the reactor threads concurrently.
+// An exception is answered with a 500.
+typedef std::function<Response(RequestContext &)> Handler;
+
+// Takes the body of a request piece by piece as it is received, before the
+// handler is called, called by the reactor threads concurrently.
+// An exception is answered with a 500.
+typedef std::function<void(RequestContext &, std::string_view)> BodyHandler;
+
+struct Route {
+    MethodTypes method;
+    MountTypes mount;
+    std::string url;
+    RouteTypes type;
+    std::string path = "";
+    // The largest request body accepted, a larger one gets a 413.
+    size_t max_body_size = MAX_BODY_SIZE;
+    // The media type of the body taken, another one gets a 415, empty for any.
+    std::string content_type = "";
+    // For a HANDLER route.
+    Handler handler = nullptr;
+    // Whether the handler may block (e.g. on a disk or a database), it is
+    // then run by the workers instead of the reactor.
+    bool blocking = false;
+    // For a HANDLER route, takes the body as it arrives, e.g. an upload
+    // written out as it comes, in pieces of at most a receive buffer. The
+    // body is then not kept in the request, the handler finds it empty.
+    BodyHandler on_body = nullptr;
+};
+
+// The deadline a connection is waiting for, at most one at a time.
+enum class Timeouts {
+    NONE,
+    HEADER,     // HEADER_TIMEOUT, from the connection or the first byte of a request
+    BODY,       // BODY_TIMEOUT, restarted by every read of the body
+    KEEPALIVE,  // KEEPALIVE_TIMEOUT, idle between two requests
+    WRITE,      // WRITE_TIMEOUT, restarted by every writable event
+    LINGER      // LINGER_TIMEOUT, from the shutdown of a refused request
+};
+
+// How the reactors wait for the sockets.
+enum class IoBackends {
+    AUTO,       // io_uring if the kernel supports it, epoll otherwise.
+    EPOLL,      // Readiness events, then recv and send.
+    URING       // Multishot accept and recv, linked sends, one system call per round.
+};
+
+// The io_uring operations of a connection in flight. The kernel uses the
+// buffers of an operation until its completion, so a closed connection is
+// only freed once none is left.
+struct UringOps {
+    uint64_t id = 0;
+    // A multishot recv is armed, and its cancellation is requested.
+    bool receiving = false;
+    bool cancelling = false;
+    bool closed = false;
+    // The linked sends, or the poll before a file range, in flight.
+    uint16_t sends = 0;
+    std::chrono::steady_clock::time_point send_start;
+};
+
+// A request whose body is being received, across readiness events.
+struct PendingRequest {
+    Request request;
+    bool active = false;
+    // The route, matched once per request, its id is 0 until then. Its
+    // views point into the request, valid until the request is handed over.
+    RouteMatch match;
+    size_t max_body_size = 0;
+    size_t body_size = 0;
+    // Handled by the workers, the next requests wait for its response.
+    bool working = false;
+};
+
+// The record of a response queued but not sent yet. It is logged once the
+// sender has sent up to its end, or with the bytes sent of it once the
+// connection is closed.
+struct UnsentRecord {
+    AccessRecord record;
+    // The bytes sent by the sender once the response is.
+    uint64_t end;
+};
 
 class ClientInfo {
 private:
     int sockfd_;
     sockaddr_in addr_;
-    uint8_t client_id_;
     std::unique_ptr<Sender> sender_;
     std::unique_ptr<Receiver> receiver_;
-
+    // Close the connection once the pending response is flushed.
+    bool closing_;
+    // The body of the last request is not read, drain it before closing
+    // so that the response is not lost to a reset.
+    bool lingering_;
+    PendingRequest pending_;
+    UringOps uring_ops_;
+    // In the order of the responses.
+    std::vector<UnsentRecord> unsent_;
+    // Keep-alive bookkeeping.
+    size_t request_count_;
+    // Scheduled in the wheel of the reactor, the slab never moves a client.
+    TimerWheel::Timer timer_;
+    Timeouts timeout_;
 
 public:
     ClientInfo(
         sockaddr_in addr,
         int sockfd,
-        uint8_t id,
         Sender *sender,
         Receiver *receiver
     );
     ~ClientInfo();
 
+    int get_sockfd();
     sockaddr_in get_addr();
     Sender *get_sender();
     Receiver *get_receiver();
+    bool is_closing();
+    void set_closing();
+    bool is_lingering();
+    void set_lingering();
+    PendingRequest *get_pending();
+    UringOps *get_uring_ops();
+    std::vector<UnsentRecord> &get_unsent();
+    size_t add_request();
+    TimerWheel::Timer &get_timer();
+    Timeouts get_timeout();
+    void set_timeout(Timeouts timeout);
 };
 
+class Reactor;
+
 class Server {
 private:
-    int sockfd_;
     sockaddr_in server_addr_;
-    std::atomic_bool running_;
-    const std::unordered_map<std::string, File> route_;
-    // Use Map/Queue with mutex for thread safety.
-    std::unique_ptr<Map<uint8_t, std::unique_ptr<ClientInfo> > > clientinfo_list_;
-    std::unique_ptr<Map<uint8_t, std::unique_ptr<std::thread> > > client_recv_list_;
+    // The id of a route is its index plus one, 0 is for the unrouted requests.
+    std::vector<Route> routes_;
+    Router router_;
+    // Indexed by route id.
+    std::vector<std::string> route_names_;
+    // Every reactor owns its own listening socket and connection set,
+    // the route table is read-only so it is shared without locking.
+    std::vector<std::unique_ptr<Reactor> > reactors_;
+    // The exact bytes of the routed files, shared by all the reactors.
+    std::unique_ptr<AssetCache> asset_cache_;
+    IoBackends backend_;
+    // Run the requests which may block, shared by all the reactors.
+    std::unique_ptr<WorkerPool> workers_;
+    // Indexed by CannedPages, read-only after construction.
+    std::vector<CannedResponse> canned_;
+    // One record per request, every reactor writes to its own ring.
+    std::unique_ptr<AccessLog> access_log_;
     std::unique_ptr<Queue<std::string> > output_queue_;
-
-    /*
-     * Wait for clients to connect.
-     */
-    void wait_for_client();
-
-    /*
-     * Keep receiving messages from the client.
-     * @param client_id The id of the client.
-     */
-    void receive_from_client(uint8_t client_id);
-
-    /*
-     * Join the threads.
-     */
-    void join_threads();
+    // The accept rate is computed between two reads of the statistics.
+    std::chrono::steady_clock::time_point start_time_;
+    std::mutex stats_mutex_;
+    std::chrono::steady_clock::time_point last_stats_time_;
+    uint64_t last_accepted_;
 
 public:
     /*
      * Connect to the server.
      * @param name The name of the client.
+     * @param addr The address to listen on.
+     * @param port The port to listen on.
+     * @param routes The routes of the server, the statistics are routed too.
+     * @param reactor_num The number of reactors, 0 for one per cpu core.
+     * @param pin_cpu Whether to pin every reactor thread to a cpu.
+     * @param cache_size The memory budget of the asset cache in bytes.
+     * @param access_log The file to append the access log to, "-" for stdout.
+     * @param huge_pages Whether to back the receive buffers with huge pages.
+     * @param backend How the reactors wait for the sockets, URING throws if
+     * the kernel does not support it.
+     * @param worker_num The number of workers, 0 for one per cpu core.
      */
     Server(
         std::string name,
         in_addr_t addr,
         int port,
-        std::unordered_map<std::string, File> route
+        const std::vector<Route> &routes,
+        size_t reactor_num = 0,
+        bool pin_cpu = false,
+        size_t cache_size = ASSET_CACHE_SIZE,
+        const std::string &access_log = "-",
+        bool huge_pages = false,
+        IoBackends backend = IoBackends::AUTO,
+        size_t worker_num = 0
     );
     ~Server();
 
     /*
      * Run the server.
-     * Keeping accepting connections from clients.
-     * Once a client is connected, a thread will be created for the client
-     * to receive messages from the client and do the corresponding actions.
+     * Start the reactors, each of them accepts the connections on its own
+     * listening socket and serves its clients as their sockets become
+     * readable or writable. Return after stop is called.
      */
     void run();
 
@@ -117,6 +336,90 @@ public:
      */
     void stop();
 
+    /*
+     * Handle a request and prepare the response.
+     * Called by the reactor threads concurrently.
+     * @param request The request to handle.
+     * @param keep_alive Whether the connection is kept open after the response.
+     * @param route_id The id of the matched route, to be logged.
+     * @return The response to send.
+     */
+    Response handle_request(const Request &request, bool keep_alive, uint16_t &route_id);
+
+    /*
+     * Check whether handling a request may block the calling thread: a
+     * file not cached yet is read from the disk (and maybe compressed),
+     * and a blocking handler may wait for anything.
+     * Called by the reactor threads concurrently.
+     * @param request The request, with its body.
+     * @param match The route of the request from accept_body, or matched
+     * here if its id is 0.
+     * @return Whether the request is better handled by the workers.
+     */
+    bool is_blocking(const Request &request, RouteMatch &match);
+
+    /*
+     * Get the workers, which handle the requests which may block.
+     */
+    WorkerPool &get_workers();
+
+    /*
+     * Check a request once its headers are received, before its body.
+     * A request which would be refused anyway (not routed, too large, or
+     * not understood by its route) is answered at once, so that a client
+     * sending Expect: 100-continue does not send the body for nothing.
+     * Called by the reactor threads concurrently.
+     * @param request The request, without its body.
+     * @param match The route of the request, its id is 0 if not routed.
+     * @param max_body_size The limit of the body of the route.
+     * @param response The response refusing the request, or the interim
+     * 100 Continue if the client waits for it, or left empty.
+     * @return Whether the body is received.
+     */
+    bool accept_body(const Request &request, RouteMatch &match, size_t &max_body_size, Response &response);
+
+    /*
+     * Pass a piece of the body of a request to its route as it arrives.
+     * The body is given to the on_body of a handler route, or else kept in
+     * the request for the handler, dropped for the other routes.
+     * Called by the reactor threads concurrently.
+     * @param match The route of the request, from accept_body.
+     * @param request The request being received.
+     * @param chunk The next bytes of the body.
+     * @return false if on_body failed, the request is then refused.
+     */
+    bool handle_body(const RouteMatch &match, Request &request, std::string_view chunk);
+
+    /*
+     * Refuse a request whose body cannot be received, and close the connection.
+     * @param request The request.
+     * @param status_code BAD_REQUEST if the body is malformed,
+     * CONTENT_TOO_LARGE if it is larger than the limit of its route,
+     * INTERNAL_SERVER_ERROR if the route failed to take it.
+     * @return The response to send.
+     */
+    Response refuse_request(const Request &request, StatusCodes status_code);
+
+    /*
+     * Log a served request to the access log.
+     * @param reactor_id The id of the calling reactor.
+     * @param record The record to log.
+     */
+    void log_access(size_t reactor_id, AccessRecord &record);
+
+    /*
+     * Merge the statistics of the reactors.
+     * The reactors keep recording while they are read.
+     * @return The statistics as a JSON document.
+     */
+    std::string get_stats();
+
+    /*
+     * Push a message to the message queue.
+     * @param message The message to print.
+     */
+    void push_message(const std::string &message);
+
     /*
      * Print the message queue.
      * @return Whether the printing is successful.
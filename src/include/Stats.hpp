@@ -0,0 +1,81 @@
+#ifndef __STATS_HPP__
+#define __STATS_HPP__
+
+#include "def.hpp"
+#include "Message.hpp"
+#include "Metrics.hpp"
+#include <memory>
+#include <vector>
+
+// The status codes counted per route, in the order of status_index.
+#define STATUS_NUM 13
+
+/*
+ * Get the index of a status code in the per-route counters.
+ * @param status_code The status code.
+ * @return The index, 0 for an unknown status code.
+ */
+inline size_t status_index(StatusCodes status_code) {
+    switch (status_code) {
+        case StatusCodes::OK:
+            return 1;
+        case StatusCodes::PARTIAL_CONTENT:
+            return 2;
+        case StatusCodes::NOT_MODIFIED:
+            return 3;
+        case StatusCodes::BAD_REQUEST:
+            return 4;
+        case StatusCodes::FORBIDDEN:
+            return 5;
+        case StatusCodes::NOT_FOUND:
+            return 6;
+        case StatusCodes::METHOD_NOT_ALLOWED:
+            return 7;
+        case StatusCodes::CONTENT_TOO_LARGE:
+            return 8;
+        case StatusCodes::UNSUPPORTED_MEDIA_TYPE:
+            return 9;
+        case StatusCodes::RANGE_NOT_SATISFIABLE:
+            return 10;
+        case StatusCodes::EXPECTATION_FAILED:
+            return 11;
+        case StatusCodes::INTERNAL_SERVER_ERROR:
+            return 12;
+        default:
+            return 0;
+    }
+}
+
+struct RouteStats {
+    Counter requests[STATUS_NUM];
+    // Bytes sent, fewer than queued if a connection is closed first.
+    Counter bytes;
+    // Time to handle a request of the route, in ns.
+    Histogram latency;
+};
+
+/*
+ * The statistics of a reactor.
+ * Only written by the reactor thread, so recording needs no lock, and
+ * read by the server which merges the reactors on demand.
+ */
+struct ReactorStats {
+    Counter accepted;
+    Counter active;
+    // The connections closed by a timeout.
+    Counter timed_out;
+    // In ns: parsing a request, handling it, and a flush of the socket.
+    Histogram parse;
+    Histogram handle;
+    Histogram send;
+    // Indexed by route id, the size is fixed at construction.
+    std::vector<std::unique_ptr<RouteStats> > routes;
+
+    explicit ReactorStats(size_t route_num) {
+        for (size_t i = 0; i < route_num; i++) {
+            routes.push_back(std::make_unique<RouteStats>());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,1021 @@
+#include "Reactor.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <climits>
+#include <algorithm>
+
+// The epoll user data of the listening socket and the wakeup eventfd,
+// they never collide with the client ids given by the Slab.
+static const uint64_t LISTEN_EVENT_ID = 0;
+static const uint64_t WAKEUP_EVENT_ID = UINT64_MAX;
+
+// The io_uring user data is the operation in the low bits, or'ed with the
+// client if any. A client is only freed once its operations complete, so
+// its address is never stale, unlike the ids of the epoll events.
+static const uint64_t URING_ACCEPT = 1;
+static const uint64_t URING_WAKEUP = 2;
+static const uint64_t URING_RECV = 3;
+static const uint64_t URING_SEND = 4;
+static const uint64_t URING_POLL = 5;
+static const uint64_t URING_CANCEL = 6;
+static const uint64_t URING_OP_MASK = 7;
+
+// The user data of an operation of a client.
+static inline uint64_t uring_data(ClientInfo *client, uint64_t op) {
+    return reinterpret_cast<uint64_t>(client) | op;
+}
+
+Reactor::Reactor(
+    Server &server,
+    size_t reactor_id,
+    const sockaddr_in &addr,
+    int cpu,
+    size_t route_num,
+    bool huge_pages,
+    IoBackends backend
+) : server_(server), reactor_id_(reactor_id), cpu_(cpu), running_(false), backend_(backend),
+    buffers_(BUFFER_SIZE, BUFFER_BLOCK_SIZE, huge_pages), clients_(MAX_CLIENT_NUM), timers_(std::chrono::milliseconds(TIMER_TICK)), stats_(route_num),
+    wakeup_value_(0), send_slot_num_(0), operations_(0) {
+    // Create a socket.
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        std::string error_msg = "Reactor Init failed: failed to create a socket. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+
+    // Set the socket to be reusable, and let every reactor bind its own
+    // listening socket to the same port so the kernel spreads the connections.
+    int opt = 1;
+    if (
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0
+    ) {
+        close(sockfd);
+        std::string error_msg = "Reactor Init failed: failed to set the socket to be reusable. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+
+    // Bind the socket to the server address and port.
+    if (bind(sockfd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0) {
+        close(sockfd);
+        std::string error_msg = "Reactor Init failed: failed to bind the socket to the server address and port. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+
+    // Listen for connections, the backlog is independent from the number
+    // of connections a reactor can hold.
+    if (listen(sockfd, LISTEN_BACKLOG) < 0) {
+        close(sockfd);
+        std::string error_msg = "Reactor Init failed: failed to listen on the socket. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+
+    // Save the socket.
+    sockfd_ = sockfd;
+
+    // Create the eventfd to wake up the reactor when stopping, or when the
+    // workers post requests back.
+    eventfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventfd_ < 0) {
+        close(sockfd_);
+        std::string error_msg = "Reactor Init failed: failed to create an eventfd. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+
+    // Keep a spare fd to drop the connections when running out of fds.
+    spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    // Register the listening socket and the eventfd to the epoll instance.
+    try {
+        epoll_ = std::make_unique<Epoll>();
+    } catch (std::exception &e) {
+        close(spare_fd_);
+        close(eventfd_);
+        close(sockfd_);
+        throw;
+    }
+    if (
+        !epoll_->add(sockfd_, EPOLLIN, LISTEN_EVENT_ID) ||
+        !epoll_->add(eventfd_, EPOLLIN, WAKEUP_EVENT_ID)
+    ) {
+        close(spare_fd_);
+        close(eventfd_);
+        close(sockfd_);
+        std::string error_msg = "Reactor Init failed: failed to register to epoll. errno: " +
+                                std::to_string(errno) + " " + strerror(errno);
+        throw std::runtime_error(error_msg);
+    }
+}
+
+Reactor::~Reactor() {
+    stop();
+    join();
+
+    // Drop the requests handled by the workers after the reactor stopped.
+    for (RequestTask *task : tasks_) {
+        delete task;
+    }
+
+    // Close the sockets, the client connections are closed by clients_.
+    if (spare_fd_ >= 0) {
+        close(spare_fd_);
+    }
+    close(eventfd_);
+    close(sockfd_);
+}
+
+void Reactor::start() {
+    running_ = true;
+    thread_ = std::thread(&Reactor::event_loop, this);
+}
+
+void Reactor::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    // Wake up the reactor thread.
+    uint64_t value = 1;
+    if (write(eventfd_, &value, sizeof(value)) < 0) {
+        server_.push_message(
+            "[ERR] Reactor Stop failed: failed to wake up reactor " +
+            std::to_string(reactor_id_) + ". errno: " +
+            std::to_string(errno) + " " + strerror(errno)
+        );
+    }
+}
+
+void Reactor::join() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+const ReactorStats &Reactor::get_stats() const {
+    return stats_;
+}
+
+const BufferPool &Reactor::get_buffers() const {
+    return buffers_;
+}
+
+// The nanoseconds elapsed between two time points.
+static inline uint64_t elapsed_ns(
+    std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end
+) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+}
+
+void Reactor::event_loop() {
+    // Pin the reactor thread if asked to.
+    if (cpu_ >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu_, &cpuset);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (error != 0) {
+            server_.push_message(
+                "[ERR] Reactor " + std::to_string(reactor_id_) +
+                " failed to pin to cpu " + std::to_string(cpu_) + ": " + strerror(error)
+            );
+        }
+    }
+
+    // The ring is created by the thread which submits to it.
+    if (backend_ == IoBackends::URING) {
+        try {
+            uring_ = std::make_unique<Uring>(URING_ENTRIES, URING_BUFFER_NUM, URING_BUFFER_SIZE);
+        } catch (std::exception &e) {
+            server_.push_message(
+                "[ERR] Reactor " + std::to_string(reactor_id_) +
+                " falls back to epoll: " + e.what()
+            );
+        }
+    }
+    if (uring_ != nullptr) {
+        uring_loop();
+        uring_.reset();
+    } else {
+        epoll_loop();
+    }
+}
+
+void Reactor::epoll_loop() {
+    std::vector<epoll_event> events(MAX_EPOLL_EVENTS);
+    while (running_) {
+        // Sleep until the next deadline, the idle connections cost nothing.
+        expire_clients();
+        int nfds = epoll_->wait(events, timers_.next_timeout());
+        if (nfds == -1) {
+            server_.push_message(
+                "[ERR] Reactor Event Loop failed: epoll_wait error. errno: " +
+                std::to_string(errno) + " " + strerror(errno)
+            );
+            return;
+        }
+        for (int i = 0; i < nfds && running_; i++) {
+            uint64_t id = events[i].data.u64;
+            try {
+                if (id == LISTEN_EVENT_ID) {
+                    accept_clients();
+                } else if (id == WAKEUP_EVENT_ID) {
+                    finish_tasks();
+                } else {
+                    handle_client(id, events[i].events);
+                }
+            } catch (std::exception &e) {
+                server_.push_message("[ERR] " + std::string(e.what()));
+            }
+        }
+    }
+}
+
+void Reactor::accept_clients() {
+    while (running_) {
+        // Accept a connection for client.
+        sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        int client_sockfd = accept4(
+            sockfd_,
+            cast_sockaddr_in(client_addr),
+            &client_addr_len,
+            SOCK_NONBLOCK | SOCK_CLOEXEC
+        );
+        if (client_sockfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if ((errno == EMFILE || errno == ENFILE) && spare_fd_ >= 0) {
+                drop_connection();
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                server_.push_message(
+                    "[ERR] Reactor Accept Clients failed: failed to accept a connection. errno: " +
+                    std::to_string(errno) + " " + strerror(errno)
+                );
+            }
+            return;
+        }
+
+        uint64_t id = add_client(client_sockfd, client_addr);
+        if (id == Slab<ClientInfo>::INVALID_ID) {
+            continue;
+        }
+
+        // Watch the client.
+        if (!epoll_->add(client_sockfd, EPOLLIN, id)) {
+            close_client(id);
+            server_.push_message(
+                "[ERR] Reactor Accept Clients failed: failed to register to epoll. errno: " +
+                std::to_string(errno) + " " + strerror(errno)
+            );
+        }
+    }
+}
+
+uint64_t Reactor::add_client(int sockfd, const sockaddr_in &addr) {
+    // Refuse the client if the connection table is full.
+    if (clients_.size() >= clients_.capacity()) {
+        close(sockfd);
+        server_.push_message("[ERR] Reactor Accept Clients failed: too many clients.");
+        return Slab<ClientInfo>::INVALID_ID;
+    }
+
+    // Create a client info.
+    Receiver *receiver = new Receiver(sockfd, buffers_);
+    Sender *sender = new Sender(sockfd);
+    uint64_t id = clients_.emplace(addr, sockfd, sender, receiver);
+    stats_.accepted.add();
+    stats_.active.set(clients_.size());
+    ClientInfo *client = clients_.get(id);
+    client->get_uring_ops()->id = id;
+    client->set_timeout(Timeouts::HEADER);
+    timers_.schedule(client->get_timer(), std::chrono::milliseconds(HEADER_TIMEOUT), id);
+    return id;
+}
+
+void Reactor::drop_connection() {
+    // Out of fds, the pending connection would keep the listening
+    // socket readable forever. Use the spare fd to accept and
+    // drop it, then take the spare fd back.
+    close(spare_fd_);
+    int client_sockfd = accept(sockfd_, nullptr, nullptr);
+    if (client_sockfd >= 0) {
+        close(client_sockfd);
+    }
+    spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    server_.push_message("[ERR] Reactor Accept Clients failed: out of file descriptors.");
+}
+
+void Reactor::handle_client(uint64_t client_id, uint32_t events) {
+    // A stale id (the client is already closed) resolves to nullptr.
+    ClientInfo *client = clients_.get(client_id);
+    if (client == nullptr) {
+        return;
+    }
+    Sender *sender = client->get_sender();
+    Receiver *receiver = client->get_receiver();
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        close_client(client_id);
+        return;
+    }
+
+    // The response to a refused request is sent, drop what the client
+    // still sends until it closes or the linger deadline passes.
+    if (client->get_timeout() == Timeouts::LINGER) {
+        ReceiveStatus status = receiver->discard();
+        if (status == ReceiveStatus::CLOSED || status == ReceiveStatus::ERROR) {
+            close_client(client_id);
+        }
+        return;
+    }
+
+    bool was_pending = sender->pending();
+    if ((events & EPOLLIN) && !client->is_closing()) {
+        // A full buffer is consumed before reading on, so a body is passed
+        // to its route one buffer at a time.
+        ReceiveStatus status;
+        while ((status = receiver->receive()) == ReceiveStatus::FULL) {
+            handle_requests(client_id, client);
+            if (client->is_closing() || client->get_pending()->working) {
+                break;
+            }
+        }
+        if (status == ReceiveStatus::CLOSED || status == ReceiveStatus::ERROR) {
+            close_client(client_id);
+            return;
+        }
+    }
+    if (!client->is_closing()) {
+        // Answer every complete request already buffered (pipelining),
+        // the responses are queued in order and flushed with one write.
+        handle_requests(client_id, client);
+        // Give the buffer back while waiting for the next bytes.
+        receiver->release_buffer();
+    }
+
+    if (sender->pending()) {
+        auto start = std::chrono::steady_clock::now();
+        SendStatus status = sender->flush();
+        stats_.send.record(elapsed_ns(start, std::chrono::steady_clock::now()));
+        log_sent(client, false);
+        if (status == SendStatus::ERROR) {
+            close_client(client_id);
+            return;
+        }
+    }
+
+    // A request is handled by the workers, the socket is not read until
+    // its response is back, and only a stalled response has a deadline.
+    if (client->get_pending()->working) {
+        epoll_->modify(client->get_sockfd(), sender->pending() ? static_cast<uint32_t>(EPOLLOUT) : 0, client_id);
+        if (sender->pending()) {
+            schedule_timeout(client_id, client);
+        } else {
+            client->set_timeout(Timeouts::NONE);
+            timers_.cancel(client->get_timer());
+        }
+        return;
+    }
+
+    // Wait for the socket to drain, for the next request,
+    // or close the connection once the last response is sent.
+    if (sender->pending()) {
+        if (!was_pending) {
+            epoll_->modify(client->get_sockfd(), EPOLLOUT, client_id);
+        }
+    } else if (client->is_closing()) {
+        if (!client->is_lingering() || shutdown(client->get_sockfd(), SHUT_WR) == -1) {
+            close_client(client_id);
+            return;
+        }
+        // Closing with unread bytes would reset the connection and could
+        // discard the response, so half-close and drain the socket first.
+        if (was_pending) {
+            epoll_->modify(client->get_sockfd(), EPOLLIN, client_id);
+        }
+        client->set_timeout(Timeouts::LINGER);
+        timers_.schedule(client->get_timer(), std::chrono::milliseconds(LINGER_TIMEOUT), client_id);
+        return;
+    } else if (was_pending) {
+        epoll_->modify(client->get_sockfd(), EPOLLIN, client_id);
+    }
+    schedule_timeout(client_id, client);
+}
+
+void Reactor::handle_requests(uint64_t client_id, ClientInfo *client) {
+    Sender *sender = client->get_sender();
+    Receiver *receiver = client->get_receiver();
+    PendingRequest *pending = client->get_pending();
+    Request &request = pending->request;
+    auto start = std::chrono::steady_clock::now();
+    while (!client->is_closing() && !pending->working) {
+        Response response;
+        bool refused = false;
+        if (!pending->active) {
+            if (!receiver->get_request(request)) {
+                break;
+            }
+            pending->active = true;
+            pending->match = RouteMatch();
+            pending->max_body_size = 0;
+            pending->body_size = 0;
+            // Check the request before its body.
+            if (receiver->stage() == ReceiveStage::BODY) {
+                refused = !server_.accept_body(request, pending->match, pending->max_body_size, response);
+                if (!refused && response.get_status_code() == StatusCodes::CONTINUE) {
+                    sender->queue_response(std::move(response));
+                }
+            }
+        }
+        auto parsed = std::chrono::steady_clock::now();
+
+        // Pass the body received so far to the route.
+        BodyStatus body_status = BodyStatus::COMPLETE;
+        std::string_view chunk;
+        while (!refused && (body_status = receiver->get_body(chunk)) == BodyStatus::DATA) {
+            pending->body_size += chunk.size();
+            if (pending->body_size > pending->max_body_size) {
+                response = server_.refuse_request(request, StatusCodes::CONTENT_TOO_LARGE);
+                refused = true;
+                break;
+            }
+            if (!server_.handle_body(pending->match, request, chunk)) {
+                response = server_.refuse_request(request, StatusCodes::INTERNAL_SERVER_ERROR);
+                refused = true;
+                break;
+            }
+        }
+        if (!refused && body_status == BodyStatus::AGAIN) {
+            break;
+        }
+        if (!refused && body_status == BodyStatus::ERROR) {
+            response = server_.refuse_request(request, StatusCodes::BAD_REQUEST);
+            refused = true;
+        }
+
+        // The body is either received or left unread with the connection.
+        bool keep_alive = false;
+        uint16_t route_id = pending->match.id;
+        if (refused) {
+            client->set_lingering();
+        } else {
+            keep_alive = running_ &&
+                         request.get_method_type() != MethodTypes::UNKNOWN &&
+                         request.is_keep_alive() &&
+                         client->add_request() < KEEPALIVE_MAX_REQUESTS;
+            // A request which may block must not stall the other clients.
+            if (server_.is_blocking(request, pending->match) && submit_request(client_id, client, keep_alive, start, parsed)) {
+                break;
+            }
+            response = server_.handle_request(request, keep_alive, route_id);
+        }
+        finish_request(
+            client, request, std::move(response), route_id, keep_alive,
+            start, parsed, std::chrono::steady_clock::now()
+        );
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+void Reactor::finish_request(
+    ClientInfo *client,
+    const Request &request,
+    Response &&response,
+    uint16_t route_id,
+    bool keep_alive,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point parsed,
+    std::chrono::steady_clock::time_point handled
+) {
+    // The response is logged once it is sent.
+    UnsentRecord unsent;
+    AccessRecord &record = unsent.record;
+    record.route = route_id;
+    record.method = static_cast<int8_t>(request.get_method_type());
+    record.status = static_cast<int16_t>(response.get_status_code());
+    record.bytes = client->get_sender()->queue_response(std::move(response));
+    record.addr = client->get_addr().sin_addr.s_addr;
+    record.port = client->get_addr().sin_port;
+    unsent.end = client->get_sender()->queued();
+    client->get_unsent().push_back(unsent);
+    // Drop the strings of the handled request, an idle connection keeps none.
+    PendingRequest *pending = client->get_pending();
+    pending->active = false;
+    pending->request = Request();
+
+    stats_.parse.record(elapsed_ns(start, parsed));
+    stats_.handle.record(elapsed_ns(parsed, handled));
+    RouteStats &route = *stats_.routes[record.route];
+    route.requests[status_index(static_cast<StatusCodes>(record.status))].add();
+    route.latency.record(elapsed_ns(parsed, handled));
+    // The header deadline of the next request starts with it.
+    client->set_timeout(Timeouts::NONE);
+    if (!keep_alive) {
+        client->set_closing();
+    }
+}
+
+void Reactor::log_sent(ClientInfo *client, bool closed) {
+    std::vector<UnsentRecord> &unsent = client->get_unsent();
+    uint64_t sent = client->get_sender()->sent();
+    size_t logged = 0;
+    while (logged < unsent.size() && (closed || unsent[logged].end <= sent)) {
+        AccessRecord &record = unsent[logged].record;
+        // A response cut short only counts the bytes the kernel accepted.
+        uint64_t start = unsent[logged].end - record.bytes;
+        record.bytes = sent > start ? std::min<uint64_t>(sent - start, record.bytes) : 0;
+        stats_.routes[record.route]->bytes.add(record.bytes);
+        server_.log_access(reactor_id_, record);
+        logged++;
+    }
+    unsent.erase(unsent.begin(), unsent.begin() + logged);
+}
+
+bool Reactor::submit_request(
+    uint64_t client_id,
+    ClientInfo *client,
+    bool keep_alive,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point parsed
+) {
+    PendingRequest *pending = client->get_pending();
+    std::unique_ptr<RequestTask> task(new RequestTask(server_, *this, client_id));
+    task->request = std::move(pending->request);
+    task->keep_alive = keep_alive;
+    task->start = start;
+    task->parsed = parsed;
+    if (!server_.get_workers().submit(task.get())) {
+        // The workers are busy, the request is handled inline.
+        pending->request = std::move(task->request);
+        return false;
+    }
+    task.release();
+    pending->working = true;
+    return true;
+}
+
+void RequestTask::run() {
+    response = server.handle_request(request, keep_alive, route_id);
+    handled = std::chrono::steady_clock::now();
+    reactor.complete(this);
+}
+
+void Reactor::complete(RequestTask *task) {
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        first = tasks_.empty();
+        tasks_.push_back(task);
+    }
+    // The reactor takes the whole batch once woken up.
+    uint64_t value = 1;
+    if (first && write(eventfd_, &value, sizeof(value)) < 0) {
+        server_.push_message(
+            "[ERR] Reactor Complete failed: failed to wake up reactor " +
+            std::to_string(reactor_id_) + ". errno: " +
+            std::to_string(errno) + " " + strerror(errno)
+        );
+    }
+}
+
+void Reactor::finish_tasks() {
+    // With epoll, reset the eventfd before taking the batch, so that a
+    // task posted meanwhile wakes the reactor up again.
+    if (uring_ == nullptr) {
+        uint64_t value;
+        if (read(eventfd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            server_.push_message(
+                "[ERR] Reactor Finish Tasks failed: failed to read the eventfd. errno: " +
+                std::to_string(errno) + " " + strerror(errno)
+            );
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        finished_.swap(tasks_);
+    }
+    for (RequestTask *task : finished_) {
+        std::unique_ptr<RequestTask> owned(task);
+        // The client may be closed meanwhile, e.g. on a timeout.
+        ClientInfo *client = clients_.get(task->client_id);
+        if (client == nullptr || (uring_ != nullptr && client->get_uring_ops()->closed)) {
+            continue;
+        }
+        try {
+            client->get_pending()->working = false;
+            finish_request(
+                client, task->request, std::move(task->response), task->route_id, task->keep_alive,
+                task->start, task->parsed, task->handled
+            );
+            if (uring_ != nullptr) {
+                resume_client(client);
+            } else {
+                // The socket was not watched for reading meanwhile.
+                epoll_->modify(client->get_sockfd(), client->get_sender()->pending() ? EPOLLOUT : EPOLLIN, task->client_id);
+                handle_client(task->client_id, 0);
+            }
+        } catch (std::exception &e) {
+            server_.push_message("[ERR] " + std::string(e.what()));
+        }
+    }
+    finished_.clear();
+}
+
+void Reactor::uring_loop() {
+    send_slots_.resize(URING_SEND_SLOT_NUM);
+    uring_->prepare_accept(sockfd_, URING_ACCEPT);
+    uring_->prepare_read(eventfd_, &wakeup_value_, sizeof(wakeup_value_), URING_WAKEUP);
+    operations_ += 2;
+
+    std::vector<io_uring_cqe> cqes(MAX_URING_EVENTS);
+    while (running_) {
+        // Submit what the last round prepared and sleep until the next
+        // deadline or completion, with a single system call.
+        expire_clients();
+        int count = uring_->wait(cqes, timers_.next_timeout());
+        send_slot_num_ = 0;
+        if (count == -1) {
+            server_.push_message(
+                "[ERR] Reactor Event Loop failed: io_uring_enter error. errno: " +
+                std::to_string(errno) + " " + strerror(errno)
+            );
+            break;
+        }
+        // Every completion is dispatched, even once stopping, since it
+        // tells which operations are over.
+        for (int i = 0; i < count; i++) {
+            try {
+                handle_completion(cqes[i]);
+            } catch (std::exception &e) {
+                server_.push_message("[ERR] " + std::string(e.what()));
+            }
+        }
+    }
+
+    // The kernel may still use the buffers of the clients, cancel every
+    // operation and wait for them to complete before the ring is closed.
+    uring_->prepare_cancel_all(URING_CANCEL);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (operations_ > 0 && std::chrono::steady_clock::now() < deadline) {
+        int count = uring_->wait(cqes, TIMER_TICK);
+        if (count == -1) {
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            const io_uring_cqe &cqe = cqes[i];
+            if (cqe.user_data != Uring::INTERNAL_DATA && (cqe.user_data & URING_OP_MASK) != URING_CANCEL &&
+                !(cqe.flags & IORING_CQE_F_MORE)) {
+                operations_--;
+            }
+        }
+    }
+}
+
+void Reactor::handle_completion(const io_uring_cqe &cqe) {
+    uint64_t op = cqe.user_data & URING_OP_MASK;
+    ClientInfo *client = reinterpret_cast<ClientInfo *>(cqe.user_data & ~URING_OP_MASK);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (cqe.user_data == Uring::INTERNAL_DATA || op == URING_CANCEL) {
+        // Only a failed cancellation completes, the operation is over anyway.
+        return;
+    }
+    if (!more) {
+        operations_--;
+    }
+
+    if (op == URING_ACCEPT) {
+        if (cqe.res >= 0) {
+            // A multishot accept returns no address, ask for it.
+            sockaddr_in client_addr;
+            socklen_t client_addr_len = sizeof(client_addr);
+            if (getpeername(cqe.res, cast_sockaddr_in(client_addr), &client_addr_len) == -1) {
+                memset(&client_addr, 0, sizeof(client_addr));
+            }
+            uint64_t id = add_client(cqe.res, client_addr);
+            if (id != Slab<ClientInfo>::INVALID_ID) {
+                arm_receive(clients_.get(id));
+            }
+        } else if ((cqe.res == -EMFILE || cqe.res == -ENFILE) && spare_fd_ >= 0) {
+            drop_connection();
+        } else if (cqe.res != -ECANCELED && cqe.res != -ECONNABORTED) {
+            server_.push_message(
+                "[ERR] Reactor Accept Clients failed: failed to accept a connection. errno: " +
+                std::to_string(-cqe.res) + " " + strerror(-cqe.res)
+            );
+        }
+        // The kernel ends a multishot accept on errors, re-arm it.
+        if (!more && running_) {
+            uring_->prepare_accept(sockfd_, URING_ACCEPT);
+            operations_++;
+        }
+        return;
+    }
+    if (op == URING_WAKEUP) {
+        // Stopping writes to the eventfd too, the loop checks running_.
+        finish_tasks();
+        if (running_) {
+            uring_->prepare_read(eventfd_, &wakeup_value_, sizeof(wakeup_value_), URING_WAKEUP);
+            operations_++;
+        }
+        return;
+    }
+
+    UringOps *ops = client->get_uring_ops();
+    if (op == URING_RECV) {
+        if (!more) {
+            ops->receiving = false;
+            ops->cancelling = false;
+        }
+        bool failed = false;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            // The bytes of a refused request, or after the last request,
+            // are dropped as the epoll path leaves them unread.
+            if (cqe.res > 0 && !ops->closed && !client->is_closing()) {
+                failed = !receive_bytes(client, uring_->buffer(buffer_id), cqe.res);
+            }
+            uring_->recycle(buffer_id);
+        }
+        if (ops->closed) {
+            release_client(client);
+            return;
+        }
+        // The kernel ends a multishot recv when it runs out of provided
+        // buffers, or when it is cancelled, it is armed again by resume_client.
+        if (failed || cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+            close_client(ops->id);
+            return;
+        }
+    } else {
+        // A send of the chain, or the poll before a file range.
+        ops->sends--;
+        if (op == URING_SEND && cqe.res > 0) {
+            client->get_sender()->complete(cqe.res);
+            log_sent(client, false);
+        }
+        if (ops->closed) {
+            release_client(client);
+            return;
+        }
+        // The sends after a failed one of the chain are cancelled.
+        if (cqe.res < 0 && cqe.res != -ECANCELED) {
+            close_client(ops->id);
+            return;
+        }
+        if (ops->sends > 0) {
+            return;
+        }
+        stats_.send.record(elapsed_ns(ops->send_start, std::chrono::steady_clock::now()));
+    }
+    resume_client(client);
+}
+
+bool Reactor::receive_bytes(ClientInfo *client, const char *data, size_t size) {
+    Receiver *receiver = client->get_receiver();
+    UringOps *ops = client->get_uring_ops();
+    while (size > 0 && !client->is_closing()) {
+        size_t used;
+        ReceiveStatus status = receiver->receive(data, size, used);
+        if (status == ReceiveStatus::ERROR) {
+            return false;
+        }
+        data += used;
+        size -= used;
+        if (status != ReceiveStatus::FULL) {
+            continue;
+        }
+        // Consume the full buffer before appending more, so a body is passed
+        // to its route one buffer at a time. While a response is in flight
+        // or a worker has the request, the bytes wait in a grown buffer, the
+        // bytes after MAX_REQUEST_SIZE are dropped.
+        if (ops->sends == 0 && !client->get_pending()->working) {
+            handle_requests(ops->id, client);
+        } else if (!receiver->grow()) {
+            break;
+        }
+    }
+    return true;
+}
+
+void Reactor::resume_client(ClientInfo *client) {
+    UringOps *ops = client->get_uring_ops();
+    Sender *sender = client->get_sender();
+    uint64_t client_id = ops->id;
+
+    // The requests received while a response is being sent wait for it in
+    // the receive buffer, and the socket is not read meanwhile, as the epoll
+    // path only watches for writability.
+    if (ops->sends > 0) {
+        if (ops->receiving && !ops->cancelling) {
+            uring_->prepare_cancel(uring_data(client, URING_RECV), uring_data(nullptr, URING_CANCEL));
+            ops->cancelling = true;
+        }
+        return;
+    }
+
+    if (!client->is_closing()) {
+        handle_requests(client_id, client);
+        // Give the buffer back while waiting for the next bytes.
+        client->get_receiver()->release_buffer();
+    }
+    if (sender->pending()) {
+        if (!send_responses(client)) {
+            close_client(client_id);
+            return;
+        }
+        if (sender->pending()) {
+            schedule_timeout(client_id, client);
+            return;
+        }
+    }
+
+    // A request is handled by the workers, the socket is not read until
+    // its response is back, and the connection has no deadline meanwhile.
+    if (client->get_pending()->working) {
+        if (ops->receiving && !ops->cancelling) {
+            uring_->prepare_cancel(uring_data(client, URING_RECV), uring_data(nullptr, URING_CANCEL));
+            ops->cancelling = true;
+        }
+        client->set_timeout(Timeouts::NONE);
+        timers_.cancel(client->get_timer());
+        return;
+    }
+
+    // Wait for the next request, or close the connection once the last
+    // response is sent.
+    if (client->is_closing()) {
+        if (client->get_timeout() != Timeouts::LINGER) {
+            if (!client->is_lingering() || shutdown(client->get_sockfd(), SHUT_WR) == -1) {
+                close_client(client_id);
+                return;
+            }
+            // Closing with unread bytes would reset the connection and could
+            // discard the response, so half-close and drain the socket first.
+            client->set_timeout(Timeouts::LINGER);
+            timers_.schedule(client->get_timer(), std::chrono::milliseconds(LINGER_TIMEOUT), client_id);
+        }
+        arm_receive(client);
+        return;
+    }
+    arm_receive(client);
+    schedule_timeout(client_id, client);
+}
+
+bool Reactor::send_responses(ClientInfo *client) {
+    UringOps *ops = client->get_uring_ops();
+    Sender *sender = client->get_sender();
+    int sockfd = client->get_sockfd();
+
+    // The slots of this round are used up, submit them to reuse them.
+    if (send_slot_num_ == send_slots_.size()) {
+        if (!uring_->submit()) {
+            return false;
+        }
+        send_slot_num_ = 0;
+    }
+    iovec batch[IOV_MAX];
+    bool more = false;
+    size_t count = sender->gather(
+        batch,
+        std::min<size_t>(IOV_MAX, (send_slots_.size() - send_slot_num_) * URING_SEND_IOV_NUM),
+        more
+    );
+    ops->send_start = std::chrono::steady_clock::now();
+    if (count == 0) {
+        // A file range is next, sendfile streams it from the page cache
+        // until the socket is full, then it waits for the socket to drain.
+        SendStatus status = sender->flush();
+        log_sent(client, false);
+        if (status == SendStatus::ERROR) {
+            return false;
+        }
+        if (status == SendStatus::PENDING) {
+            uring_->prepare_poll(sockfd, POLLOUT, uring_data(client, URING_POLL));
+            ops->sends++;
+            operations_++;
+        }
+        return true;
+    }
+
+    // Every sendmsg of the chain starts once the previous one has sent all
+    // its bytes (MSG_WAITALL), so the responses go out in order.
+    for (size_t i = 0; i < count; i += URING_SEND_IOV_NUM) {
+        size_t iov_num = std::min<size_t>(count - i, URING_SEND_IOV_NUM);
+        bool last = i + iov_num == count;
+        SendSlot &slot = send_slots_[send_slot_num_++];
+        std::copy(batch + i, batch + i + iov_num, slot.iov);
+        memset(&slot.msg, 0, sizeof(slot.msg));
+        slot.msg.msg_iov = slot.iov;
+        slot.msg.msg_iovlen = iov_num;
+        int flags = MSG_NOSIGNAL | MSG_WAITALL | (last && more ? MSG_MORE : 0);
+        uring_->prepare_sendmsg(sockfd, &slot.msg, flags, !last, uring_data(client, URING_SEND));
+        ops->sends++;
+        operations_++;
+    }
+    return true;
+}
+
+void Reactor::arm_receive(ClientInfo *client) {
+    UringOps *ops = client->get_uring_ops();
+    if (ops->receiving) {
+        return;
+    }
+    uring_->prepare_recv(client->get_sockfd(), uring_data(client, URING_RECV));
+    ops->receiving = true;
+    operations_++;
+}
+
+void Reactor::release_client(ClientInfo *client) {
+    UringOps *ops = client->get_uring_ops();
+    if (ops->closed && !ops->receiving && ops->sends == 0) {
+        log_sent(client, true);
+        clients_.erase(ops->id);
+        stats_.active.set(clients_.size());
+    }
+}
+
+void Reactor::schedule_timeout(uint64_t client_id, ClientInfo *client) {
+    Timeouts timeout;
+    int milliseconds;
+    if (client->get_sender()->pending()) {
+        timeout = Timeouts::WRITE;
+        milliseconds = WRITE_TIMEOUT;
+    } else {
+        switch (client->get_receiver()->stage()) {
+            case ReceiveStage::HEADERS:
+                // The headers have to arrive in time however slowly they
+                // trickle in, so the deadline is not pushed back.
+                if (client->get_timeout() == Timeouts::HEADER) {
+                    return;
+                }
+                timeout = Timeouts::HEADER;
+                milliseconds = HEADER_TIMEOUT;
+                break;
+            case ReceiveStage::BODY:
+                timeout = Timeouts::BODY;
+                milliseconds = BODY_TIMEOUT;
+                break;
+            default:
+                timeout = Timeouts::KEEPALIVE;
+                milliseconds = KEEPALIVE_TIMEOUT;
+                break;
+        }
+    }
+    client->set_timeout(timeout);
+    timers_.schedule(client->get_timer(), std::chrono::milliseconds(milliseconds), client_id);
+}
+
+void Reactor::expire_clients() {
+    expired_.clear();
+    timers_.advance(expired_);
+    for (uint64_t client_id : expired_) {
+        ClientInfo *client = clients_.get(client_id);
+        if (client == nullptr) {
+            continue;
+        }
+        // The end of a linger is not a timeout of the client.
+        if (client->get_timeout() != Timeouts::LINGER) {
+            stats_.timed_out.add();
+        }
+        close_client(client_id);
+    }
+}
+
+void Reactor::close_client(uint64_t client_id) {
+    // Remove the client, the socket is closed by ClientInfo
+    // and thus removed from the epoll instance.
+    ClientInfo *client = clients_.get(client_id);
+    if (client == nullptr) {
+        return;
+    }
+    timers_.cancel(client->get_timer());
+    if (uring_ != nullptr) {
+        // The kernel uses the buffers of the operations in flight until they
+        // complete, cancel them and free the client then.
+        UringOps *ops = client->get_uring_ops();
+        if (ops->closed) {
+            return;
+        }
+        ops->closed = true;
+        if (ops->receiving || ops->sends > 0) {
+            uring_->prepare_cancel_fd(client->get_sockfd(), uring_data(nullptr, URING_CANCEL));
+            return;
+        }
+    }
+    log_sent(client, true);
+    clients_.erase(client_id);
+    stats_.active.set(clients_.size());
+}
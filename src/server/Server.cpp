@@ -1,34 +1,182 @@
 #include "Server.hpp"
+#include "Reactor.hpp"
+#include "Mime.hpp"
 #include <stdexcept>
 #include <iostream>
-#include <fstream>
 #include <chrono>
 #include <ctime>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <strings.h>
 #include <netinet/tcp.h>
+#include <sys/resource.h>
 
-std::string get_file_type(FileTypes type) {
-    switch (type) {
-        case FileTypes::HTML:
-            return "text/html";
-        case FileTypes::JPG:
-            return "image/jpeg";
-        case FileTypes::ICO:
-            return "image/x-icon";
-        case FileTypes::TXT:
-            return "text/plain";
-        default:
-            throw std::invalid_argument("Invalid file type");
+// The route id of the requests outside the routes,
+// the routes are numbered from 1 in order.
+static const uint16_t NO_ROUTE_ID = 0;
+
+// The url of the statistics.
+static const char *const STATS_URL = "/__stats";
+
+// Join the root of a directory mount and the rest of the url,
+// the dot segments are refused so the path stays under the root.
+static bool resolve_path(const std::string &root, std::string_view rest, std::string &path) {
+    if (rest.find('\0') != std::string_view::npos) {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= rest.size()) {
+        size_t end = rest.find('/', start);
+        if (end == std::string_view::npos) {
+            end = rest.size();
+        }
+        std::string_view segment = rest.substr(start, end - start);
+        if (segment == "." || segment == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+    while (!rest.empty() && rest[0] == '/') {
+        rest.remove_prefix(1);
+    }
+    path = root;
+    if (path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    path += rest;
+    // A directory is served by its index.
+    if (path.back() == '/') {
+        path += "index.html";
+    }
+    return true;
+}
+
+// Compare a header value with a token case-insensitively.
+static bool same_token(std::string_view value, std::string_view token) {
+    return value.size() == token.size() && strncasecmp(value.data(), token.data(), token.size()) == 0;
+}
+
+// Read a Content-Length, its digits are checked by the parser.
+static size_t parse_length(std::string_view value) {
+    size_t length = 0;
+    for (char c : value) {
+        length = length * 10 + (c - '0');
     }
+    return length;
+}
+
+// Check whether the entity tag of an asset is in an If-None-Match list,
+// the tags are compared weakly (RFC 9110 13.1.2).
+static bool etag_matches(std::string_view if_none_match, const std::string &etag) {
+    size_t pos = 0;
+    while (pos < if_none_match.size()) {
+        char c = if_none_match[pos];
+        if (c == ' ' || c == '\t' || c == ',') {
+            pos++;
+            continue;
+        }
+        if (c == '*') {
+            return true;
+        }
+        if (if_none_match.compare(pos, 2, "W/") == 0) {
+            pos += 2;
+        }
+        if (pos >= if_none_match.size() || if_none_match[pos] != '"') {
+            return false;
+        }
+        size_t end = if_none_match.find('"', pos + 1);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        if (if_none_match.compare(pos, end + 1 - pos, etag) == 0) {
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// Evaluate the preconditions of a conditional GET against the asset sent,
+// If-None-Match takes precedence over If-Modified-Since.
+static bool is_not_modified(const Request &request, const Asset &asset) {
+    std::optional<std::string_view> if_none_match = request.get_header(HeaderNames::IF_NONE_MATCH);
+    if (if_none_match) {
+        return etag_matches(*if_none_match, asset.get_etag());
+    }
+    std::optional<std::string_view> if_modified_since = request.get_header(HeaderNames::IF_MODIFIED_SINCE);
+    time_t since;
+    if (if_modified_since && parse_http_date(*if_modified_since, since)) {
+        return asset.get_mtime() <= since;
+    }
+    return false;
+}
+
+// Evaluate If-Range against the asset sent: the ranges are only sent if
+// the client holds the same bytes, so an entity tag is compared strongly
+// and a date must be the modification time.
+static bool range_applies(const Request &request, const Asset &asset) {
+    std::optional<std::string_view> if_range = request.get_header(HeaderNames::IF_RANGE);
+    if (!if_range) {
+        return true;
+    }
+    if (!if_range->empty() && (if_range->front() == '"' || if_range->compare(0, 2, "W/") == 0)) {
+        return *if_range == asset.get_etag();
+    }
+    time_t date;
+    return parse_http_date(*if_range, date) && date == asset.get_mtime();
+}
+
+// Format the Content-Range of a range of a body.
+static std::string content_range(const ByteRange &range, size_t size) {
+    return "bytes " + std::to_string(range.offset) + "-" +
+           std::to_string(range.offset + range.length - 1) + "/" + std::to_string(size);
+}
+
+// Draw the boundary of a multipart/byteranges body, a new one for every
+// response so that it can neither be predicted nor be planted in a file.
+static std::string range_boundary() {
+    static thread_local std::random_device device;
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%08x%08x%08x", device(), device(), device());
+    return std::string(buffer);
+}
+
+// Point a body at a range of the bytes of an asset variant: in place if it
+// is in memory, streamed from its fd otherwise. The asset keeps them alive.
+static void slice_asset(
+    const std::shared_ptr<const Asset> &asset,
+    const Asset &variant,
+    const ByteRange &range,
+    SharedBody &shared_body,
+    FileBody &file_body
+) {
+    if (variant.in_memory()) {
+        shared_body.owner = asset;
+        shared_body.data = variant.data() + range.offset;
+        shared_body.size = range.length;
+    } else {
+        file_body.owner = asset;
+        file_body.fd = variant.fd();
+        file_body.offset = range.offset;
+        file_body.length = range.length;
+    }
+}
+
+std::string get_client_addr(const sockaddr_in &addr) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
 }
 
 ClientInfo::ClientInfo(
     sockaddr_in addr,
     int sockfd,
-    uint8_t id,
     Sender *sender,
     Receiver *receiver
-) : sockfd_(sockfd), addr_(addr), client_id_(id) {
+) : sockfd_(sockfd), addr_(addr), closing_(false), lingering_(false), request_count_(0),
+    timeout_(Timeouts::NONE) {
     sender_ = std::unique_ptr<Sender>(sender);
     receiver_ = std::unique_ptr<Receiver>(receiver);
 }
@@ -38,6 +186,10 @@ ClientInfo::~ClientInfo() {
     close(sockfd_);
 }
 
+int ClientInfo::get_sockfd() {
+    return sockfd_;
+}
+
 sockaddr_in ClientInfo::get_addr() {
     return addr_;
 }
@@ -50,399 +202,670 @@ Receiver *ClientInfo::get_receiver() {
     return receiver_.get();
 }
 
+bool ClientInfo::is_closing() {
+    return closing_;
+}
+
+void ClientInfo::set_closing() {
+    closing_ = true;
+}
+
+bool ClientInfo::is_lingering() {
+    return lingering_;
+}
+
+void ClientInfo::set_lingering() {
+    lingering_ = true;
+}
+
+PendingRequest *ClientInfo::get_pending() {
+    return &pending_;
+}
+
+std::vector<UnsentRecord> &ClientInfo::get_unsent() {
+    return unsent_;
+}
+
+UringOps *ClientInfo::get_uring_ops() {
+    return &uring_ops_;
+}
+
+size_t ClientInfo::add_request() {
+    return ++request_count_;
+}
+
+TimerWheel::Timer &ClientInfo::get_timer() {
+    return timer_;
+}
+
+Timeouts ClientInfo::get_timeout() {
+    return timeout_;
+}
+
+void ClientInfo::set_timeout(Timeouts timeout) {
+    timeout_ = timeout;
+}
+
+// The query string of a url, between the '?' and the fragment.
+static std::string_view query_string(std::string_view url) {
+    size_t question = url.find('?');
+    if (question == std::string_view::npos) {
+        return std::string_view();
+    }
+    std::string_view query = url.substr(question + 1);
+    return query.substr(0, query.find('#'));
+}
+
+RequestContext::RequestContext(
+    const Request &request,
+    const RouteMatch &match,
+    bool keep_alive,
+    const std::vector<CannedResponse> &canned
+) : request_(request), match_(match), keep_alive_(keep_alive), canned_(canned),
+    query_(query_string(request.get_url())), form_(request.get_body()) {}
+
+const Request &RequestContext::get_request() const {
+    return request_;
+}
+
+std::string_view RequestContext::get_path() const {
+    return match_.path;
+}
+
+std::string_view RequestContext::get_rest() const {
+    return match_.rest;
+}
+
+Form &RequestContext::get_query() {
+    return query_;
+}
+
+Form &RequestContext::get_form() {
+    return form_;
+}
+
+Response RequestContext::respond(StatusCodes status_code, std::string_view content_type, std::string body) const {
+    Response response(status_code, request_.get_version());
+    response.set_header(HeaderNames::CONTENT_TYPE, content_type)
+            .set_header(HeaderNames::CONTENT_LENGTH, std::to_string(body.size()))
+            .set_header(HeaderNames::CONNECTION, keep_alive_ ? "keep-alive" : "close")
+            .set_body(std::move(body));
+    return response;
+}
+
+Response RequestContext::respond(CannedPages page) const {
+    return canned_[static_cast<size_t>(page)].respond(request_.get_version(), keep_alive_);
+}
+
 Server::Server(
     std::string name,
     in_addr_t addr,
     int port,
-    std::unordered_map<std::string, File> route
-) : running_(true), route_(route) {
+    const std::vector<Route> &routes,
+    size_t reactor_num,
+    bool pin_cpu,
+    size_t cache_size,
+    const std::string &access_log,
+    bool huge_pages,
+    IoBackends backend,
+    size_t worker_num
+) : routes_(routes), backend_(backend) {
     // Prepare the server_addr_.
     server_addr_.sin_family = AF_INET;
     server_addr_.sin_port = htons(port);
     server_addr_.sin_addr.s_addr = addr;
 
-    // Create a socket.
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        std::string error_msg = "Server Init failed: failed to create a socket. errno: " +
-                                std::to_string(errno) + " " + strerror(errno);
-        throw std::runtime_error(error_msg);
-    }
+    output_queue_ = std::unique_ptr<Queue<std::string> >(
+        new Queue<std::string>()
+    );
+    asset_cache_ = std::make_unique<AssetCache>(cache_size, SENDFILE_MIN_SIZE);
+
+    // Serialize the fixed responses, in the order of CannedPages.
+    const Headers html = {{"Content-Type", "text/html"}};
+    canned_.emplace_back(
+        StatusCodes::BAD_REQUEST,
+        html,
+        "<html><body><h1>400 Bad Request</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::OK,
+        html,
+        "<html><body><h1>Login success</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::FORBIDDEN,
+        html,
+        "<html><body><h1>403 Forbidden (incorrect login or password)</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::NOT_FOUND,
+        html,
+        "<html><body><h1>404 Not Found</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::CONTENT_TOO_LARGE,
+        html,
+        "<html><body><h1>413 Content Too Large</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::UNSUPPORTED_MEDIA_TYPE,
+        html,
+        "<html><body><h1>415 Unsupported Media Type</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::EXPECTATION_FAILED,
+        html,
+        "<html><body><h1>417 Expectation Failed</h1></body></html>"
+    );
+    canned_.emplace_back(
+        StatusCodes::INTERNAL_SERVER_ERROR,
+        html,
+        "<html><body><h1>500 Internal Server Error</h1></body></html>"
+    );
 
-    // Set the socket to be reusable.
-    int opt = 1;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        close(sockfd);
-        std::string error_msg = "Server Init failed: failed to set the socket to be reusable. errno: " +
-                                std::to_string(errno) + " " + strerror(errno);
-        throw std::runtime_error(error_msg);
+    // Every connection takes a fd, raise the soft limit as far as allowed.
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
     }
 
-    // Bind the socket to the server address and port.
-    if (bind(sockfd, cast_sockaddr_in(server_addr_), sizeof(server_addr_)) < 0) {
-        close(sockfd);
-        std::string error_msg = "Server Init failed: failed to bind the socket to the server address and port. errno: " +
-                                std::to_string(errno) + " " + strerror(errno);
-        throw std::runtime_error(error_msg);
+    // Use io_uring where the kernel supports everything it needs.
+    if (backend_ == IoBackends::AUTO) {
+        backend_ = Uring::supported() ? IoBackends::URING : IoBackends::EPOLL;
+    } else if (backend_ == IoBackends::URING && !Uring::supported()) {
+        throw std::runtime_error("Server Init failed: io_uring is not supported by the kernel.");
     }
 
-    // Listen for connections for maximum MAX_CLIENT_NUM clients.
-    listen(sockfd, MAX_CLIENT_NUM);
+    // Create the reactors, one per cpu core by default.
+    long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_num < 1) {
+        cpu_num = 1;
+    }
+    if (reactor_num == 0) {
+        reactor_num = cpu_num;
+    }
 
-    // Save the socket.
-    sockfd_ = sockfd;
+    // Start the workers, one per cpu core by default too, they mostly
+    // wait for the disk.
+    workers_ = std::make_unique<WorkerPool>(worker_num == 0 ? cpu_num : worker_num, WORKER_QUEUE_SIZE);
 
-    // Create the lists.
-    clientinfo_list_ = std::unique_ptr<Map<uint8_t, std::unique_ptr<ClientInfo> > >(
-        new Map<uint8_t, std::unique_ptr<ClientInfo> >()
-    );
-    client_recv_list_ = std::unique_ptr<Map<uint8_t, std::unique_ptr<std::thread> > >(
-        new Map<uint8_t, std::unique_ptr<std::thread> >()
-    );
-    output_queue_ = std::unique_ptr<Queue<std::string> >(
-        new Queue<std::string>()
-    );
+    // Route the urls, throws if a url is routed twice.
+    routes_.push_back({MethodTypes::GET, MountTypes::EXACT, STATS_URL, RouteTypes::STATS});
+    route_names_.push_back("-");
+    for (size_t i = 0; i < routes_.size(); i++) {
+        router_.add(routes_[i].method, routes_[i].mount, routes_[i].url, i + 1);
+        route_names_.push_back(routes_[i].url);
+    }
+    router_.build();
+
+    // Start the access log, with one ring per reactor.
+    access_log_ = std::make_unique<AccessLog>(access_log, route_names_, reactor_num);
+    start_time_ = last_stats_time_ = std::chrono::steady_clock::now();
+    last_accepted_ = 0;
+
+    for (size_t i = 0; i < reactor_num; i++) {
+        int cpu = pin_cpu ? static_cast<int>(i % cpu_num) : -1;
+        reactors_.push_back(std::make_unique<Reactor>(
+            *this, i, server_addr_, cpu, route_names_.size(), huge_pages, backend_
+        ));
+    }
 }
 
 Server::~Server() {
-    // Join all the client threads.
+    // Join all the reactor threads.
     output_queue_->push("[INFO] Releasing the threads.");
     output_message();
-    join_threads();
+    for (auto &reactor : reactors_) {
+        reactor->join();
+    }
+    // The requests left are handled and posted back to the reactors,
+    // which drop them.
+    workers_.reset();
     output_queue_->push("[INFO] Released the threads.");
     output_message();
 
-    // Close all the client connections.
-    // Get shared_mutex for clientinfo_list_.
-    std::unique_lock<std::mutex> clientinfo_list_lock(clientinfo_list_->get_mutex());
-
-    // Close the socket.
-    close(sockfd_);
+    // Close all the client connections and the sockets.
+    reactors_.clear();
 
     // Output the remaining messages.
     output_queue_->push("[INFO] Released the server.");
     output_message();
 }
 
-void Server::wait_for_client() {
-    // Accept a connection for client.
-    sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
-    int client_sockfd = accept(sockfd_, cast_sockaddr_in(client_addr), &client_addr_len);
-    if (!running_) {
-        // if the server is not running, close the socket and return.
-        if (client_sockfd >= 0) {
-            close(client_sockfd);
-        }
-        return;
-    }
-    if (client_sockfd < 0) {
-        std::string error_msg = "Server Wait For Client failed: failed to accept a connection. errno: " +
-                                std::to_string(errno) + " " + strerror(errno);
-        throw std::runtime_error(error_msg);
-    }
-
-    // Create a client info.
-    // Find a valid client id.
-    uint8_t id = 1;
-    std::unique_lock<std::mutex> clientinfo_list_lock(clientinfo_list_->get_mutex());
-    while (clientinfo_list_->check_exist(id, clientinfo_list_lock)) {
-        id++;
-        if (id == 0) {
-            close(client_sockfd);
-            throw std::runtime_error("Server Wait For Client failed: no free client id.");
+Response Server::handle_request(const Request &request, bool keep_alive, uint16_t &route_id) {
+    route_id = NO_ROUTE_ID;
+
+    // check the type of the request.
+    // Prepare the response.
+    // The fixed responses are only pointed at, not built.
+    StatusCodes status_code = StatusCodes::INTERNAL_SERVER_ERROR;
+    const CannedResponse *canned = nullptr;
+    Headers headers;
+    std::string body;
+    SharedBody shared_body;
+    FileBody file_body;
+    std::vector<BodyPart> parts;
+    // The file to serve, if any.
+    std::string path;
+    bool is_directory = false;
+    if (request.get_method_type() == MethodTypes::UNKNOWN) {
+        canned = &canned_[static_cast<size_t>(CannedPages::BAD_REQUEST)];
+    } else {
+        // Route the url, the query string is ignored.
+        const std::string &url = request.get_url();
+        RouteMatch match;
+        RouteStatus route_status = router_.match(request.get_method_type(), url, match);
+        if (route_status == RouteStatus::NOT_FOUND) {
+            // If the url is not found, return 404.
+            canned = &canned_[static_cast<size_t>(CannedPages::NOT_FOUND)];
+        } else if (route_status == RouteStatus::METHOD_NOT_ALLOWED) {
+            // If the url is routed for other methods, return 405 with them.
+            status_code = StatusCodes::METHOD_NOT_ALLOWED;
+            std::string allow;
+            for (int i = 0; i < Router::METHOD_NUM; i++) {
+                if (match.allowed & (1u << i)) {
+                    allow += (allow.empty() ? "" : ", ") +
+                             method_type_to_string(static_cast<MethodTypes>(i));
+                }
+            }
+            body = "<html><body><h1>405 Method Not Allowed</h1></body></html>";
+            headers.set(HeaderNames::CONTENT_TYPE, "text/html");
+            headers.set(HeaderNames::CONTENT_LENGTH, std::to_string(body.size()));
+            headers.set(HeaderNames::ALLOW, allow);
+        } else {
+            const Route &route = routes_[match.id - 1];
+            route_id = match.id;
+            switch (route.type) {
+                case RouteTypes::STATS:
+                    // Report the statistics, never cached.
+                    status_code = StatusCodes::OK;
+                    body = get_stats();
+                    headers.set(HeaderNames::CONTENT_TYPE, "application/json");
+                    headers.set(HeaderNames::CONTENT_LENGTH, std::to_string(body.size()));
+                    headers.set(HeaderNames::CACHE_CONTROL, "no-store");
+                    break;
+                case RouteTypes::HANDLER: {
+                    // The handler builds the whole response.
+                    RequestContext context(request, match, keep_alive, canned_);
+                    try {
+                        return route.handler(context);
+                    } catch (std::exception &e) {
+                        push_message("[ERR] Handler of " + route.url + " failed: " + e.what());
+                        canned = &canned_[static_cast<size_t>(CannedPages::INTERNAL_SERVER_ERROR)];
+                    }
+                    break;
+                }
+                case RouteTypes::FILE:
+                    path = route.path;
+                    break;
+                case RouteTypes::DIRECTORY:
+                    is_directory = true;
+                    if (!resolve_path(route.path, match.rest, path)) {
+                        canned = &canned_[static_cast<size_t>(CannedPages::NOT_FOUND)];
+                    }
+                    break;
+            }
         }
     }
 
-    // Create a client info.
-    Receiver *receiver = new Receiver(client_sockfd);
-    Sender *sender = new Sender(client_sockfd);
-    std::unique_ptr<ClientInfo> client_info = std::make_unique<ClientInfo>(
-        client_addr,
-        client_sockfd,
-        id,
-        sender,
-        receiver
-    );
-    clientinfo_list_->insert_or_assign(id, std::move(client_info), clientinfo_list_lock);
-    // Create threads for the client.
-    std::unique_ptr<std::thread> recv_thread = std::make_unique<std::thread>(
-        &Server::receive_from_client,
-        this,
-        id
-    );
-    std::unique_lock<std::mutex> client_recv_list_lock(client_recv_list_->get_mutex());
-    if (client_recv_list_->check_exist(id, client_recv_list_lock)) {
-        client_recv_list_->at(id, client_recv_list_lock)->join();
-        client_recv_list_->at(id, client_recv_list_lock).release();
-    }
-    client_recv_list_->insert_or_assign(id, std::move(recv_thread), client_recv_list_lock);
-}
-
-void Server::receive_from_client(uint8_t client_id) {
-    // Check if the client id is valid.
-    std::unique_lock<std::mutex> clientinfo_list_lock(clientinfo_list_->get_mutex());
-    if (!clientinfo_list_->check_exist(client_id, clientinfo_list_lock)) {
-        throw std::runtime_error("Server Receive From Client failed: invalid client id.");
-    }
-
-    Sender *sender = clientinfo_list_->at(client_id, clientinfo_list_lock)->get_sender();
-    Receiver *receiver = clientinfo_list_->at(client_id, clientinfo_list_lock)->get_receiver();
-
-    // delete the unique_lock
-    clientinfo_list_lock.unlock();
-
-    Request request;
-    if (receiver->get_request(request) && running_) {
-        std::unique_lock<std::mutex> lock(clientinfo_list_->get_mutex());
-
-        // Print the message.
-        output_queue_->push(
-            "[INFO] Received request from " +
-            get_client_addr(client_id, lock)
-        );
-
-        // check the type of the request.
-        // Prepare the response.
-        StatusCodes status_code;
-        std::unordered_map<std::string, std::string> headers;
-        std::string body = "";
-        if (request.get_method_type() == MethodTypes::GET) {
-            // Log the request.
-            output_queue_->push(
-                "[INFO] GET " +
-                request.get_url() +
-                " " +
-                request.get_version() +
-                " from " +
-                get_client_addr(client_id, lock)
-            );
-
-            // Check if the url is valid.
-            std::string url = request.get_url();
-            if (route_.find(url) == route_.end()) {
-                // If the url is not found, return 404.
-                status_code = StatusCodes::NOT_FOUND;
-
-                // Prepare the 404 response body.
-                body = "<html><body><h1>404 Not Found</h1></body></html>";
-
-                // Prepare the 404 response headers.
-                headers["Content-Type"] = "text/html";
-                headers["Content-Length"] = std::to_string(body.length());
-            } else {
-                // Get the file and prepare the response body.
-                File file = route_.at(url);
-                // Open the file.
-                std::ifstream file_stream(file.path, std::ios::in | std::ios::binary);
-                if (file_stream.is_open()) {
-                    // If the url is found, and the file is opened, return 200.
-                    status_code = StatusCodes::OK;
-
-                    // Read the file.
-                    while (file_stream.eof() == false) {
-                        std::string line;
-                        std::getline(file_stream, line);
-                        body += line + "\n";
+    if (!path.empty()) {
+        // Get the exact bytes of the file from the asset cache,
+        // keyed by path so the routes of a file share it.
+        std::shared_ptr<const Asset> asset = asset_cache_->get(path, mime_type(path));
+        if (asset != nullptr) {
+            // Pick the preferred encoded variant the client accepts.
+            const Asset *variant = asset.get();
+            if (asset->has_encodings()) {
+                headers.set(HeaderNames::VARY, "Accept-Encoding");
+                std::optional<std::string_view> accept_encoding = request.get_header(HeaderNames::ACCEPT_ENCODING);
+                unsigned accepted = accept_encoding ? accept_encodings(*accept_encoding) : 0;
+                for (Encodings encoding : {Encodings::BROTLI, Encodings::GZIP}) {
+                    if ((accepted & (1u << static_cast<int>(encoding))) && asset->encoded(encoding) != nullptr) {
+                        variant = asset->encoded(encoding);
+                        headers.set(HeaderNames::CONTENT_ENCODING, encoding_to_string(encoding));
+                        break;
                     }
-
-                    // Prepare the 200 response headers.
-                    headers["Content-Type"] = get_file_type(file.type);
-                    headers["Content-Length"] = std::to_string(body.length());
-                } else {
-                    // Return 500 if the file cannot be opened.
-                    status_code = StatusCodes::INTERNAL_SERVER_ERROR;
-
-                    // Prepare the 500 response body.
-                    body = "<html><body><h1>500 Internal Server Error</h1></body></html>";
-
-                    // Prepare the 500 response headers.
-                    headers["Content-Type"] = "text/html";
-                    headers["Content-Length"] = std::to_string(body.length());
                 }
             }
-        } else if (request.get_method_type() == MethodTypes::POST) {
-            // Log the request.
-            output_queue_->push(
-                "[INFO] POST " +
-                request.get_url() +
-                " " +
-                request.get_version() +
-                " from " +
-                get_client_addr(client_id, lock)
-            );
-
-            // Check if the url is valid.
-            std::string url = request.get_url();
-            if (url != "/dopost") {
-                // If the url is not found, return 404.
-                status_code = StatusCodes::NOT_FOUND;
-
-                // Prepare the 404 response body.
-                body = "<html><body><h1>404 Not Found</h1></body></html>";
-
-                // Prepare the 404 response headers.
-                headers["Content-Type"] = "text/html";
-                headers["Content-Length"] = std::to_string(body.length());
+
+            headers.set(HeaderNames::ETAG, variant->get_etag());
+            headers.set(HeaderNames::LAST_MODIFIED, variant->get_last_modified());
+            headers.set(HeaderNames::ACCEPT_RANGES, "bytes");
+            std::optional<std::string_view> range = request.get_header(HeaderNames::RANGE);
+            std::vector<ByteRange> ranges;
+            if (is_not_modified(request, *variant)) {
+                // The client has the file already, return 304 without the body.
+                status_code = StatusCodes::NOT_MODIFIED;
+            } else if (
+                !range ||
+                !range_applies(request, *variant) ||
+                !parse_range(*range, variant->size(), ranges)
+            ) {
+                // If the url is found, and the file is loaded, return 200.
+                // The cached bytes are sent in place and a large file is
+                // streamed with sendfile, the asset keeps its variants alive.
+                status_code = StatusCodes::OK;
+                slice_asset(asset, *variant, {0, variant->size()}, shared_body, file_body);
+                headers.set(HeaderNames::CONTENT_TYPE, variant->get_content_type());
+                headers.set(HeaderNames::CONTENT_LENGTH, variant->get_content_length());
+            } else if (ranges.empty()) {
+                // No range overlaps the file, return 416 with its size.
+                status_code = StatusCodes::RANGE_NOT_SATISFIABLE;
+                body = "<html><body><h1>416 Range Not Satisfiable</h1></body></html>";
+                headers.set(HeaderNames::CONTENT_TYPE, "text/html");
+                headers.set(HeaderNames::CONTENT_LENGTH, std::to_string(body.size()));
+                headers.set(HeaderNames::CONTENT_RANGE, "bytes */" + std::to_string(variant->size()));
+            } else if (ranges.size() == 1) {
+                // Return 206 with the range only.
+                status_code = StatusCodes::PARTIAL_CONTENT;
+                slice_asset(asset, *variant, ranges[0], shared_body, file_body);
+                headers.set(HeaderNames::CONTENT_TYPE, variant->get_content_type());
+                headers.set(HeaderNames::CONTENT_LENGTH, std::to_string(ranges[0].length));
+                headers.set(HeaderNames::CONTENT_RANGE, content_range(ranges[0], variant->size()));
             } else {
-                // Get body.
-                std::string req_body = request.get_body();
-                // Body is like "login=123&pass=asd".
-                // Parse the req_body.
-                std::unordered_map<std::string, std::string> body_map;
-                int pos = 0;
-                while ((pos = req_body.find('&')) != std::string::npos) {
-                    std::string pair = req_body.substr(0, pos);
-                    int pos2 = pair.find('=');
-                    std::string key = pair.substr(0, pos2);
-                    std::string value = pair.substr(pos2 + 1);
-                    body_map.insert_or_assign(key, value);
-                    req_body.erase(0, pos + 1);
+                // Return 206 with the ranges as the parts of a multipart body,
+                // every part is sent in place or streamed like a whole file.
+                status_code = StatusCodes::PARTIAL_CONTENT;
+                std::string boundary = range_boundary();
+                size_t length = 0;
+                for (auto &byte_range : ranges) {
+                    parts.emplace_back();
+                    BodyPart &part = parts.back();
+                    part.head = "\r\n--" + boundary +
+                                "\r\nContent-Type: " + variant->get_content_type() +
+                                "\r\nContent-Range: " + content_range(byte_range, variant->size()) +
+                                "\r\n\r\n";
+                    slice_asset(asset, *variant, byte_range, part.shared_body, part.file_body);
+                    length += part.head.size() + byte_range.length;
                 }
-                int pos2 = req_body.find('=');
-                int pos3 = req_body.find('.');
-                std::string key = req_body.substr(0, pos2);
-                std::string value = req_body.substr(pos2 + 1, pos3 - pos2 - 1);
-                body_map.insert_or_assign(key, value);
-
-                // Check if the login and pass exist.
-                if (
-                    body_map.find("login") != body_map.end() &&
-                    body_map.find("pass") != body_map.end()
-                ) {
-                    // Check if the login and pass are correct.
-                    if (
-                        body_map.at("login") == USERNAME &&
-                        body_map.at("pass") == PASSWORD
-                    ) {
-                        // If the login and pass are correct, return 200.
-                        status_code = StatusCodes::OK;
-                        // Prepare the 200 response body.
-                        body = "<html><body><h1>Login success</h1></body></html>";
-                    } else {
-                        // If the login and pass are incorrect, return 403.
-                        status_code = StatusCodes::FORBIDDEN;
-                        // Prepare the 403 response body.
-                        body = "<html><body><h1>403 Forbidden (incorrect login or password)</h1></body></html>";
-                    }
+                parts.emplace_back();
+                parts.back().head = "\r\n--" + boundary + "--\r\n";
+                length += parts.back().head.size();
+                headers.set(HeaderNames::CONTENT_TYPE, "multipart/byteranges; boundary=" + boundary);
+                headers.set(HeaderNames::CONTENT_LENGTH, std::to_string(length));
+            }
+        } else if (is_directory) {
+            // A missing file under a directory is not found.
+            canned = &canned_[static_cast<size_t>(CannedPages::NOT_FOUND)];
+        } else {
+            // Return 500 if the routed file cannot be opened.
+            canned = &canned_[static_cast<size_t>(CannedPages::INTERNAL_SERVER_ERROR)];
+        }
+    }
 
-                    // Prepare the response headers.
-                    headers["Content-Type"] = "text/html";
-                    headers["Content-Length"] = std::to_string(body.length());
+    if (canned != nullptr) {
+        return canned->respond(request.get_version(), keep_alive);
+    }
 
-                } else {
-                    // If the login and pass do not exist, return 400.
-                    status_code = StatusCodes::BAD_REQUEST;
+    // Tell the client whether the connection stays open.
+    headers.set(HeaderNames::CONNECTION, keep_alive ? "keep-alive" : "close");
 
-                    // Prepare the 400 response body.
-                    body = "<html><body><h1>400 Bad Request</h1></body></html>";
+    // Move the headers and the bodies into the response, nothing is copied.
+    Response response(status_code, request.get_version(), std::move(headers), std::move(body));
+    response.set_shared_body(std::move(shared_body))
+            .set_file_body(std::move(file_body))
+            .set_parts(std::move(parts));
+    return response;
+}
 
-                    // Prepare the 400 response headers.
-                    headers["Content-Type"] = "text/html";
-                    headers["Content-Length"] = std::to_string(body.length());
-                }
-            }
-        } else {
-            // Log the request.
-            output_queue_->push(
-                "[INFO] Unknown request from " +
-                get_client_addr(client_id, lock)
-            );
-
-            // Prepare the response.
-            status_code = StatusCodes::BAD_REQUEST;
-            
-            // Prepare the 400 response body.
-            body = "<html><body><h1>400 Bad Request</h1></body></html>";
-
-            // Prepare the 400 response headers.
-            headers["Content-Type"] = "text/html";
-            headers["Content-Length"] = std::to_string(body.length());
+bool Server::is_blocking(const Request &request, RouteMatch &match) {
+    // A request with a body is routed by accept_body already.
+    if (match.id == NO_ROUTE_ID && (
+        request.get_method_type() == MethodTypes::UNKNOWN ||
+        router_.match(request.get_method_type(), request.get_url(), match) != RouteStatus::FOUND
+    )) {
+        match = RouteMatch();
+        return false;
+    }
+    const Route &route = routes_[match.id - 1];
+    switch (route.type) {
+        case RouteTypes::HANDLER:
+            return route.blocking;
+        case RouteTypes::FILE:
+            return !asset_cache_->contains(route.path);
+        case RouteTypes::DIRECTORY: {
+            std::string path;
+            return resolve_path(route.path, match.rest, path) && !asset_cache_->contains(path);
         }
+        default:
+            return false;
+    }
+}
 
-        // Log the response.
-        output_queue_->push(
-            "[INFO] " +
-            status_code_to_string(status_code) +
-            request.get_url() +
-            " " +
-            request.get_version() +
-            " from " +
-            get_client_addr(client_id, lock)
-        );
-
-        // Send the response.
-        Response response(
-            status_code,
-            request.get_version(),
-            headers,
-            body
-        );
-        sender->send_response(response);
-    }
-
-    // Relock the unique_lock
-    clientinfo_list_lock.lock();
-    output_queue_->push(
-        "[INFO] Sent response to " +
-        get_client_addr(client_id, clientinfo_list_lock)
-    );
-
-    // Remove the client.
-    clientinfo_list_->erase(client_id, clientinfo_list_lock);
+WorkerPool &Server::get_workers() {
+    return *workers_;
 }
 
-void Server::join_threads() {
-    std::unique_lock<std::mutex> client_recv_list_lock(client_recv_list_->get_mutex());
-    for (
-        auto it = client_recv_list_->begin(client_recv_list_lock);
-        it != client_recv_list_->end(client_recv_list_lock);
-        it++
+bool Server::accept_body(const Request &request, RouteMatch &match, size_t &max_body_size, Response &response) {
+    max_body_size = 0;
+
+    // A request not routed is answered as usual, without reading its body.
+    const std::string &url = request.get_url();
+    if (
+        request.get_method_type() == MethodTypes::UNKNOWN ||
+        router_.match(request.get_method_type(), url, match) != RouteStatus::FOUND
     ) {
-        it->second->join();
+        match = RouteMatch();
+        response = handle_request(request, false, match.id);
+        return false;
+    }
+    const Route &route = routes_[match.id - 1];
+    max_body_size = route.max_body_size;
+
+    // Refuse what the route would refuse once the body is received.
+    CannedPages refusal = CannedPages::BAD_REQUEST;
+    bool refused = false;
+    std::optional<std::string_view> expect = request.get_header(HeaderNames::EXPECT);
+    std::optional<std::string_view> content_length = request.get_header(HeaderNames::CONTENT_LENGTH);
+    std::optional<std::string_view> content_type = request.get_header(HeaderNames::CONTENT_TYPE);
+    if (expect && !same_token(*expect, "100-continue")) {
+        refusal = CannedPages::EXPECTATION_FAILED;
+        refused = true;
+    } else if (content_length && parse_length(*content_length) > max_body_size) {
+        refusal = CannedPages::CONTENT_TOO_LARGE;
+        refused = true;
+    } else if (!route.content_type.empty() && content_type) {
+        // The route only takes one media type, e.g. the login form of test.html.
+        std::string_view type = content_type->substr(0, content_type->find(';'));
+        while (!type.empty() && (type.back() == ' ' || type.back() == '\t')) {
+            type.remove_suffix(1);
+        }
+        if (!same_token(type, route.content_type)) {
+            refusal = CannedPages::UNSUPPORTED_MEDIA_TYPE;
+            refused = true;
+        }
+    }
+    if (refused) {
+        response = canned_[static_cast<size_t>(refusal)].respond(request.get_version(), false);
+        return false;
+    }
+
+    // An HTTP/1.1 client may wait for the go-ahead before sending the body.
+    if (expect && request.get_version() == "HTTP/1.1") {
+        response = Response(StatusCodes::CONTINUE, request.get_version());
+    }
+    return true;
+}
+
+bool Server::handle_body(const RouteMatch &match, Request &request, std::string_view chunk) {
+    // Only a handler reads the body, the other bodies are dropped as they arrive.
+    if (match.id == NO_ROUTE_ID || routes_[match.id - 1].type != RouteTypes::HANDLER) {
+        return true;
+    }
+    const Route &route = routes_[match.id - 1];
+    if (route.on_body == nullptr) {
+        request.append_body(chunk);
+        return true;
+    }
+    // The context only serves to read the request, the handler responds.
+    RequestContext context(request, match, false, canned_);
+    try {
+        route.on_body(context, chunk);
+    } catch (std::exception &e) {
+        push_message("[ERR] Body handler of " + route.url + " failed: " + e.what());
+        return false;
+    }
+    return true;
+}
+
+Response Server::refuse_request(const Request &request, StatusCodes status_code) {
+    CannedPages refusal = CannedPages::BAD_REQUEST;
+    if (status_code == StatusCodes::CONTENT_TOO_LARGE) {
+        refusal = CannedPages::CONTENT_TOO_LARGE;
+    } else if (status_code == StatusCodes::INTERNAL_SERVER_ERROR) {
+        refusal = CannedPages::INTERNAL_SERVER_ERROR;
     }
+    return canned_[static_cast<size_t>(refusal)].respond(request.get_version(), false);
 }
 
 void Server::run() {
-    while (running_) {
-        try {
-            // Wait for clients to connect.
-            wait_for_client();
-            if (!running_) {
-                break;
-            }
-        } catch (std::exception &e) {
-            output_queue_->push("[ERR] " + std::string(e.what()));
-        }
+    for (auto &reactor : reactors_) {
+        reactor->start();
+    }
+    for (auto &reactor : reactors_) {
+        reactor->join();
     }
 }
 
 void Server::stop() {
     output_queue_->push("[INFO] Stopping the server...");
-    running_ = false;
-    // Close the socket.
-    shutdown(sockfd_, SHUT_RDWR);
-    // Close all the client connections.
-    // Get shared_mutex for clientinfo_list_.
-    std::unique_lock<std::mutex> clientinfo_list_lock(clientinfo_list_->get_mutex());
-    for (
-        auto it = clientinfo_list_->begin(clientinfo_list_lock);
-        it != clientinfo_list_->end(clientinfo_list_lock);
-        it++
-    ) {
-        // Send a DISCONNECT REQUEST.
-        it->second->get_receiver()->close();
+    for (auto &reactor : reactors_) {
+        reactor->stop();
+    }
+}
+
+void Server::log_access(size_t reactor_id, AccessRecord &record) {
+    access_log_->log(reactor_id, record);
+}
+
+// Format the percentiles of a histogram as a JSON object.
+static std::string histogram_to_json(const Histogram &histogram) {
+    return "{\"count\": " + std::to_string(histogram.count()) +
+           ", \"p50\": " + std::to_string(histogram.percentile(50)) +
+           ", \"p99\": " + std::to_string(histogram.percentile(99)) +
+           ", \"p999\": " + std::to_string(histogram.percentile(99.9)) +
+           ", \"max\": " + std::to_string(histogram.max()) + "}";
+}
+
+std::string Server::get_stats() {
+    static const char *const status_names[STATUS_NUM] = {
+        "unknown", "200", "206", "304", "400", "403", "404", "405", "413", "415", "416", "417", "500"
+    };
+
+    // Merge the reactors, their counters are only read.
+    uint64_t accepted = 0;
+    uint64_t active = 0;
+    uint64_t timed_out = 0;
+    uint64_t borrowed = 0;
+    uint64_t mapped = 0;
+    uint64_t huge_mapped = 0;
+    uint64_t large = 0;
+    auto parse = std::make_unique<Histogram>();
+    auto handle = std::make_unique<Histogram>();
+    auto send = std::make_unique<Histogram>();
+    std::vector<std::unique_ptr<RouteStats> > routes;
+    for (size_t i = 0; i < route_names_.size(); i++) {
+        routes.push_back(std::make_unique<RouteStats>());
     }
+    for (auto &reactor : reactors_) {
+        const ReactorStats &stats = reactor->get_stats();
+        accepted += stats.accepted.get();
+        active += stats.active.get();
+        timed_out += stats.timed_out.get();
+        borrowed += reactor->get_buffers().borrowed();
+        mapped += reactor->get_buffers().mapped();
+        huge_mapped += reactor->get_buffers().huge_mapped();
+        large += reactor->get_buffers().large();
+        parse->merge(stats.parse);
+        handle->merge(stats.handle);
+        send->merge(stats.send);
+        for (size_t i = 0; i < routes.size(); i++) {
+            for (size_t j = 0; j < STATUS_NUM; j++) {
+                routes[i]->requests[j].add(stats.routes[i]->requests[j].get());
+            }
+            routes[i]->bytes.add(stats.routes[i]->bytes.get());
+            routes[i]->latency.merge(stats.routes[i]->latency);
+        }
+    }
+
+    // The accept rate since the last read.
+    auto now = std::chrono::steady_clock::now();
+    double rate;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        double seconds = std::chrono::duration<double>(now - last_stats_time_).count();
+        rate = seconds > 0 ? (accepted - last_accepted_) / seconds : 0;
+        last_stats_time_ = now;
+        last_accepted_ = accepted;
+    }
+    char rate_str[32];
+    snprintf(rate_str, sizeof(rate_str), "%.1f", rate);
+
+    std::string json = "{\n";
+    json += "  \"uptime\": " + std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(now - start_time_).count()
+    ) + ",\n";
+    json += "  \"backend\": \"" + std::string(backend_ == IoBackends::URING ? "io_uring" : "epoll") + "\",\n";
+    json += "  \"connections\": {\"active\": " + std::to_string(active) +
+            ", \"accepted\": " + std::to_string(accepted) +
+            ", \"accept_rate\": " + rate_str +
+            ", \"timed_out\": " + std::to_string(timed_out) + "},\n";
+    json += "  \"buffers\": {\"borrowed\": " + std::to_string(borrowed) +
+            ", \"borrowed_bytes\": " + std::to_string(borrowed * BUFFER_SIZE) +
+            ", \"mapped_bytes\": " + std::to_string(mapped) +
+            ", \"huge_bytes\": " + std::to_string(huge_mapped) +
+            ", \"large_bytes\": " + std::to_string(large) + "},\n";
+    json += "  \"access_log\": {\"depth\": " + std::to_string(access_log_->depth()) +
+            ", \"dropped\": " + std::to_string(access_log_->dropped()) + "},\n";
+    json += "  \"workers\": {\"threads\": " + std::to_string(workers_->size()) +
+            ", \"queued\": " + std::to_string(workers_->queued()) +
+            ", \"executed\": " + std::to_string(workers_->executed()) +
+            ", \"stolen\": " + std::to_string(workers_->stolen()) +
+            ", \"rejected\": " + std::to_string(workers_->rejected()) + "},\n";
+    json += "  \"latency_ns\": {\n";
+    json += "    \"parse\": " + histogram_to_json(*parse) + ",\n";
+    json += "    \"handle\": " + histogram_to_json(*handle) + ",\n";
+    json += "    \"send\": " + histogram_to_json(*send) + "\n";
+    json += "  },\n";
+    json += "  \"routes\": {";
+    bool first = true;
+    for (size_t i = 0; i < routes.size(); i++) {
+        std::string requests;
+        for (size_t j = 0; j < STATUS_NUM; j++) {
+            uint64_t count = routes[i]->requests[j].get();
+            if (count != 0) {
+                requests += std::string(requests.empty() ? "" : ", ") +
+                            "\"" + status_names[j] + "\": " + std::to_string(count);
+            }
+        }
+        if (requests.empty()) {
+            continue;
+        }
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "    \"" + route_names_[i] + "\": {\"requests\": {" + requests + "}" +
+                ", \"bytes\": " + std::to_string(routes[i]->bytes.get()) +
+                ", \"latency_ns\": " + histogram_to_json(routes[i]->latency) + "}";
+    }
+    json += "\n  }\n}\n";
+    return json;
+}
+
+void Server::push_message(const std::string &message) {
+    output_queue_->push(message);
 }
 
 bool Server::output_message() {
     if (output_queue_->empty()) {
         return false;
     }
-    std::cout << std::endl;
+    // Flush once for the whole batch.
+    std::cout << '\n';
     while (!output_queue_->empty()) {
         std::string output = output_queue_->pop();
-        std::cout << output << std::endl;
+        std::cout << output << '\n';
     }
+    std::cout.flush();
     return true;
 }
@@ -8,6 +8,37 @@ std::string get_command() {
     return command;
 }
 
+// Check the login form posted by test.html.
+static Response login(RequestContext &context) {
+    Form &form = context.get_form();
+    std::optional<std::string_view> login = form.get("login");
+    std::optional<std::string_view> pass = form.get("pass");
+    if (!login || !pass) {
+        return context.respond(CannedPages::BAD_REQUEST);
+    }
+    if (*login == USERNAME && *pass == PASSWORD) {
+        return context.respond(CannedPages::LOGIN_SUCCESS);
+    }
+    return context.respond(CannedPages::LOGIN_FAILED);
+}
+
+// The bytes and the pieces of the bodies taken by /upload so far.
+static std::atomic<uint64_t> uploaded_bytes(0);
+static std::atomic<uint64_t> uploaded_pieces(0);
+
+// Take an upload as it arrives, without keeping it.
+static void upload_body(RequestContext &, std::string_view chunk) {
+    uploaded_bytes += chunk.size();
+    uploaded_pieces++;
+}
+
+// Answer an upload with the totals of all the uploads so far.
+static Response upload(RequestContext &context) {
+    std::string body = std::to_string(uploaded_bytes) + " bytes in " +
+                       std::to_string(uploaded_pieces) + " pieces uploaded\n";
+    return context.respond(StatusCodes::OK, "text/plain", std::move(body));
+}
+
 int main(int argc, char *argv[]) {
     // Prepare arguments.
     char *hostname = new char[128];
@@ -16,9 +47,15 @@ int main(int argc, char *argv[]) {
     delete[] hostname;
     in_addr_t addr = SERVER_ADDR;
     int port = SERVER_PORT;
+    size_t reactor_num = 0;
+    bool pin_cpu = false;
+    std::string access_log = "-";
+    bool huge_pages = false;
+    IoBackends backend = IoBackends::AUTO;
+    size_t worker_num = 0;
 
     // If there are arguments, use them.
-    // in order: <name> <addr> <port>
+    // in order: <name> <addr> <port> <reactors> <pin> <log> <hugepages> <backend> <workers>
     if (argc > 1) {
         name = argv[1];
     }
@@ -28,24 +65,73 @@ int main(int argc, char *argv[]) {
     if (argc > 3) {
         port = atoi(argv[3]);
     }
+    if (argc > 4) {
+        reactor_num = atoi(argv[4]);
+    }
+    if (argc > 5) {
+        pin_cpu = atoi(argv[5]) != 0;
+    }
+    if (argc > 6) {
+        access_log = argv[6];
+    }
+    if (argc > 7) {
+        huge_pages = atoi(argv[7]) != 0;
+    }
+    if (argc > 8) {
+        std::string value = argv[8];
+        if (value == "epoll") {
+            backend = IoBackends::EPOLL;
+        } else if (value == "io_uring") {
+            backend = IoBackends::URING;
+        } else if (value != "auto") {
+            std::cout << "[ERR] Unknown backend \"" << value << "\", expected auto, epoll or io_uring." << std::endl;
+            return 1;
+        }
+    }
+    if (argc > 9) {
+        worker_num = atoi(argv[9]);
+    }
 
-    std::unordered_map<std::string, File> route;
-    route["/"] = {FileTypes::HTML, "assets/html/test.html"};
-    route["/test.html"] = {FileTypes::HTML, "assets/html/test.html"};
-    route["/noimg.html"] = {FileTypes::HTML, "assets/html/noimg.html"};
-    route["/txt/test.txt"] = {FileTypes::TXT, "assets/txt/test.txt"};
-    route["/img/logo.jpg"] = {FileTypes::JPG, "assets/img/logo.jpg"};
-    route["/favicon.ico"] = {FileTypes::ICO, "assets/img/favicon.ico"};
-    route["/post"] = {FileTypes::HTML, "", true};
+    // The Content-Type of a file comes from its extension,
+    // a login form is a few bytes so its body is kept small.
+    // A dynamic page is a route with a handler, an upload streams its body
+    // to the route instead of holding it.
+    std::vector<Route> routes = {
+        {MethodTypes::GET, MountTypes::EXACT, "/", RouteTypes::FILE, "assets/html/test.html"},
+        {MethodTypes::GET, MountTypes::EXACT, "/test.html", RouteTypes::FILE, "assets/html/test.html"},
+        {MethodTypes::GET, MountTypes::EXACT, "/noimg.html", RouteTypes::FILE, "assets/html/noimg.html"},
+        {MethodTypes::GET, MountTypes::EXACT, "/txt/test.txt", RouteTypes::FILE, "assets/txt/test.txt"},
+        {MethodTypes::GET, MountTypes::EXACT, "/img/logo.jpg", RouteTypes::FILE, "assets/img/logo.jpg"},
+        {MethodTypes::GET, MountTypes::EXACT, "/favicon.ico", RouteTypes::FILE, "assets/img/favicon.ico"},
+        {MethodTypes::GET, MountTypes::PREFIX, "/static/", RouteTypes::DIRECTORY, "assets"},
+        {MethodTypes::POST, MountTypes::EXACT, "/dopost", RouteTypes::HANDLER, "", 4096, "application/x-www-form-urlencoded", login},
+        {MethodTypes::POST, MountTypes::EXACT, "/upload", RouteTypes::HANDLER, "", 1ull << 30, "", upload, false, upload_body}
+    };
 
     std::cout << "[INFO] Server host name: " << name << std::endl;
     std::cout << "[INFO] Server address: " << inet_ntoa(*(in_addr *)&addr) << std::endl;
     std::cout << "[INFO] Server port: " << port << std::endl;
+    if (reactor_num == 0) {
+        std::cout << "[INFO] Server reactors: one per cpu core" << std::endl;
+    } else {
+        std::cout << "[INFO] Server reactors: " << reactor_num << std::endl;
+    }
+    std::cout << "[INFO] Server cpu pinning: " << (pin_cpu ? "on" : "off") << std::endl;
+    std::cout << "[INFO] Server access log: " << (access_log == "-" ? "stdout" : access_log) << std::endl;
+    std::cout << "[INFO] Server huge pages: " << (huge_pages ? "on" : "off") << std::endl;
+    std::cout << "[INFO] Server I/O backend: " << (
+        backend == IoBackends::EPOLL ? "epoll" : backend == IoBackends::URING ? "io_uring" : "auto"
+    ) << std::endl;
+    if (worker_num == 0) {
+        std::cout << "[INFO] Server workers: one per cpu core" << std::endl;
+    } else {
+        std::cout << "[INFO] Server workers: " << worker_num << std::endl;
+    }
 
     // Create a server.
     std::unique_ptr<Server> server;
     try {
-        server = std::unique_ptr<Server>(new Server(name, addr, port, route));
+        server = std::unique_ptr<Server>(new Server(name, addr, port, routes, reactor_num, pin_cpu, ASSET_CACHE_SIZE, access_log, huge_pages, backend, worker_num));
     } catch (std::exception &e) {
         std::cout << "[ERR] " << e.what() << std::endl;
         return 1;
@@ -60,14 +146,15 @@ int main(int argc, char *argv[]) {
     std::future_status status;
     try {
         while (true) {
-            // Print outputs in the msg queue.
+            // Print outputs in the msg queue, the requests are logged
+            // by the access log, so only the rare messages are left.
             server->output_message();
 
             // Get the command.
             if (status == std::future_status::deferred) {
                 command_future = std::async(std::launch::async, get_command);
             }
-            status = command_future.wait_for(std::chrono::milliseconds(1));
+            status = command_future.wait_for(std::chrono::milliseconds(100));
             if (status == std::future_status::ready) {
                 command = command_future.get();
                 // Prepare but not start the next thread.
@@ -80,8 +167,10 @@ int main(int argc, char *argv[]) {
 
             if (command == "exit") {
                 break;
+            } else if (command == "stats") {
+                std::cout << server->get_stats() << std::flush;
             } else {
-                std::cout << "[INFO] Please enter \"exit\" to close the server." << std::endl;
+                std::cout << "[INFO] Please enter \"exit\" to close the server, or \"stats\" to print the statistics." << std::endl;
             }
         }
     } catch (std::exception &e) {